@@ -0,0 +1,51 @@
+#ifndef backoff_h
+#define backoff_h
+#include <Arduino.h>
+
+// Capped exponential backoff with jitter for reconnecting to a server.
+// Every failed attempt doubles the delay up to maxDelay. The actual wait
+// is drawn from the upper half of the delay, so clocks that lost the same
+// broker do not all retry at once.
+class Backoff
+{
+public:
+    Backoff(uint32_t initialDelay, uint32_t maxDelay)
+        : _initialDelay(initialDelay), _maxDelay(maxDelay), _delay(initialDelay)
+    {
+    }
+
+    // true once the wait after the last failure is over
+    bool due(uint32_t now) const
+    {
+        return !_waiting || (int32_t)(now - _next) >= 0;
+    }
+
+    void failed(uint32_t now)
+    {
+        uint32_t wait = _delay / 2 + random(_delay / 2 + 1);
+        _next = now + wait;
+        _waiting = true;
+        _delay = _delay > _maxDelay / 2 ? _maxDelay : _delay * 2;
+    }
+
+    void reset()
+    {
+        _delay = _initialDelay;
+        _waiting = false;
+    }
+
+    // ms until the next attempt is due
+    uint32_t remaining(uint32_t now) const
+    {
+        return due(now) ? 0 : _next - now;
+    }
+
+private:
+    uint32_t _initialDelay;
+    uint32_t _maxDelay;
+    uint32_t _delay;
+    uint32_t _next = 0;
+    bool _waiting = false;
+};
+
+#endif //backoff_h
@@ -0,0 +1,57 @@
+#ifndef chunkedprint_h
+#define chunkedprint_h
+#include <Arduino.h>
+
+// Collects output in a small fixed buffer and hands it on in chunks, so
+// large responses never have to be assembled in a String on the heap.
+// Derived classes decide where the chunks go and must call flush() in
+// their destructor.
+class ChunkedPrint : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        _buffer[_length++] = c;
+        if (_length == sizeof(_buffer))
+        {
+            flush();
+        }
+        return 1;
+    }
+
+    size_t write(const uint8_t *data, size_t size) override
+    {
+        size_t remaining = size;
+        while (remaining > 0)
+        {
+            size_t n = min(remaining, sizeof(_buffer) - _length);
+            memcpy(_buffer + _length, data, n);
+            _length += n;
+            data += n;
+            remaining -= n;
+            if (_length == sizeof(_buffer))
+            {
+                flush();
+            }
+        }
+        return size;
+    }
+
+    void flush() override
+    {
+        if (_length > 0)
+        {
+            sendChunk(_buffer, _length);
+            _length = 0;
+        }
+    }
+
+protected:
+    virtual void sendChunk(const char *data, size_t length) = 0;
+
+private:
+    char _buffer[256];
+    size_t _length = 0;
+};
+
+#endif //chunkedprint_h
@@ -2,6 +2,7 @@
 #define color_h
 #include <NeoPixelBus.h>
 #include "config.hpp"
+#include "compositor.hpp"
 
 RgbColor colorFromSetting(const ColorSetting &setting)
 {
@@ -19,86 +20,6 @@ RgbColor colorFromSetting(const ColorSetting &setting)
     return RgbColor(hsbColor);
 }
 
-void renderAlarm(bool night = false, bool bg = false)
-{
-    int length = 1;
-
-    float brightness = 1.0;
-    if (night)
-    {
-        brightness = 0.1;
-    }
-    HsbColor animationColor(1, 1, brightness);
-
-    if (bg)
-    {
-        bgStrip->ClearTo(off);
-        length = config.config.bgLedCount;
-    }
-    else
-    {
-
-        strip->ClearTo(off);
-        length = config.config.ledCount;
-    }
-
-    for (uint16_t i = 0; i < length; i++)
-    {
-        if (i % 4 == 0)
-        {
-            if (bg)
-            {
-                bgStrip->SetPixelColor(i, animationColor);
-            }
-            else
-            {
-                strip->SetPixelColor(i, animationColor);
-            }
-        }
-        yield();
-    }
-}
-
-void renderRainbow(bool night = false, bool bg = false)
-{
-    int length = 1;
-
-    float brightness = 1.0;
-    if (night)
-    {
-        brightness = 0.1;
-    }
-
-    if (bg)
-    {
-        bgStrip->ClearTo(off);
-        length = config.config.bgLedCount;
-    }
-    else
-    {
-
-        strip->ClearTo(off);
-        length = config.config.ledCount;
-    }
-
-    float hueStep = 1.0 / (float)length;
-    for (uint16_t i = 0; i < length; i++)
-    {
-        float hue = hueStep * i;
-        HsbColor animationColor(hue, 1, brightness);
-
-        if (bg)
-        {
-            bgStrip->SetPixelColor(i, animationColor);
-        }
-        else
-        {
-            strip->SetPixelColor(i, animationColor);
-        }
-        yield();
-    }
-}
-
 void updateColors(bool isNight = false)
 {
 
@@ -128,6 +49,7 @@ void updateColors(bool isNight = false)
         monthColor = colorFromSetting(config.config.monthColor);
         weekdayColor = colorFromSetting(config.config.weekdayColor);
     }
+    compositor.invalidate(LAYERS_ALL);
 }
 
 #endif //color_h
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef compositor_h
+#define compositor_h
+#include <Arduino.h>
+
+// Layers of the time display from bottom to top
+enum ClockLayer : uint8_t
+{
+    LAYER_BACKGROUND, // the backlight strip
+    LAYER_MARKERS,    // hour dots, quarters and the hour segment
+    LAYER_HANDS,
+    LAYER_DATE, // day, month and weekday markers
+    LAYER_COUNT
+};
+
+#define LAYER_BIT(layer) (1 << (layer))
+#define LAYERS_ALL (LAYER_BIT(LAYER_COUNT) - 1)
+#define LAYERS_CLOCK (LAYER_BIT(LAYER_MARKERS) | LAYER_BIT(LAYER_HANDS) | LAYER_BIT(LAYER_DATE))
+
+// Keeps track of which layers of the time display changed. Layers that
+// cover many pixels but rarely change keep their pixels in a cache, so
+// composing a frame starts with a memcpy instead of drawing them again.
+// A dirty layer has to be drawn again, a pending one only has to get
+// back into the pixels of the strips, from its cache if it has one. A
+// composed layer is in the strips but has not been shown yet.
+class Compositor
+{
+public:
+    ~Compositor()
+    {
+        for (Cache &cache : _caches)
+        {
+            delete[] cache.pixels;
+        }
+    }
+
+    // The content of layers changed, e.g. with the time or the colors
+    void invalidate(uint8_t layers)
+    {
+        _dirty |= layers;
+        _pending |= layers;
+    }
+
+    // The strips were drawn by something else, all layers have to be
+    // composed again but their caches are still valid
+    void recompose()
+    {
+        _pending = LAYERS_ALL;
+    }
+
+    bool dirty(ClockLayer layer) const
+    {
+        return _dirty & LAYER_BIT(layer);
+    }
+
+    // True if any of layers is not in the strips yet
+    bool pending(uint8_t layers) const
+    {
+        return _pending & layers;
+    }
+
+    // The layers are drawn and in the strips
+    void done(uint8_t layers)
+    {
+        _dirty &= ~layers;
+        _pending &= ~layers;
+        _composed |= layers;
+    }
+
+    // True if the strips still show layers as they were last shown, so
+    // their pixels need no comparison
+    bool unchanged(uint8_t layers) const
+    {
+        return !((_pending | _composed) & layers);
+    }
+
+    // The strips holding layers were shown
+    void shown(uint8_t layers)
+    {
+        _composed &= ~layers;
+    }
+
+    // Cache of size bytes for layer, a new one marks the layer dirty
+    uint8_t *cache(ClockLayer layer, size_t size)
+    {
+        Cache &cache = _caches[layer];
+        if (cache.size != size)
+        {
+            delete[] cache.pixels;
+            cache.pixels = new uint8_t[size ? size : 1];
+            cache.size = size;
+            invalidate(LAYER_BIT(layer));
+        }
+        return cache.pixels;
+    }
+
+private:
+    struct Cache
+    {
+        uint8_t *pixels = nullptr;
+        size_t size = 0;
+    };
+    Cache _caches[LAYER_COUNT];
+    uint8_t _dirty = LAYERS_ALL;
+    uint8_t _pending = LAYERS_ALL;
+    uint8_t _composed = 0;
+};
+
+Compositor compositor;
+
+#endif //compositor_h
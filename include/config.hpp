@@ -1,7 +1,7 @@
 #ifndef config_h
 #define config_h
 #include <ArduinoJson.h>
-#if defined(ESP8266)
+#if defined(ESP8266) || defined(NATIVE_BUILD)
 #include <FS.h>
 #include <LittleFS.h>
 #elif defined(ESP32)
@@ -59,6 +59,7 @@ struct ConfigData
     bool hourLight;
     bool blendColors;
     bool fluidMotion;
+    uint32_t frameRate;
 
     bool alarmActive;
     uint32_t alarmTime;
@@ -72,6 +73,7 @@ struct ConfigData
     uint32_t ledPin;
     uint32_t ledCount;
     uint32_t ledRoot;
+    uint32_t clockLedCount;
 
     char language[3];
 
@@ -87,22 +89,98 @@ struct ConfigData
     bool tlsBundleLoaded;
 };
 
+// Header of config.bin, the ConfigData struct follows it as is. Bump
+// CONFIG_VERSION whenever the layout of ConfigData or the header changes.
+#define CONFIG_MAGIC 0x47464345 // "ECFG"
+#define CONFIG_VERSION 2
+
+struct ConfigHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t crc;
+    uint32_t writeCount; // flash writes over the lifetime of the file
+};
+
+// Groups of settings the derived state of the loop depends on. Publishing
+// a config sets the bits of all groups with a changed field in
+// Config::dirty, the loop only rebuilds what depends on those.
+#define CONFIG_DIRTY_COLORS (1 << 0)   // colors, hand styles and indicators
+#define CONFIG_DIRTY_GEOMETRY (1 << 1) // LED layout of the clock face
+#define CONFIG_DIRTY_NIGHT (1 << 2)    // night window
+#define CONFIG_DIRTY_ALARM (1 << 3)
+#define CONFIG_DIRTY_STRIP (1 << 4)    // pins and strip lengths
+#define CONFIG_DIRTY_MQTT (1 << 5)
+#define CONFIG_DIRTY_TIMING (1 << 6)   // frame rate
+#define CONFIG_DIRTY_SYSTEM (1 << 7)   // hostname, time server, time zone, language
+
+// A requested save is written once no further change came in for
+// SAVE_QUIET_MS, but no later than SAVE_MAX_DELAY_MS after the first one
+#define CONFIG_JSON_CAPACITY 2048 // bytes of a JSON document holding the whole config
+
+#define SAVE_QUIET_MS 3000
+#define SAVE_MAX_DELAY_MS 30000
+
+// Scalar settings that can be read and written one at a time by name,
+// e.g. "nightTimeBegins" or "hourColor/hue", without a JSON document
+#define CONFIG_FIELD_COUNT 60
+
+// Changes are prepared in the inactive one of two buffers and then
+// published, so a change that fails halfway never shows. Everything runs
+// in the loop task, the web server and MQTT handlers included, so the
+// buffers need neither locks nor atomics. A writer on another task or
+// core would need std::atomic with release and acquire ordering for
+// _published and generation.
 class Config
 {
 public:
     Config();
+    // Snapshot of the published config for the render loop, only updated
+    // by snapshot(). Writers never touch it. This third copy costs about
+    // 0.9 KB of RAM. A pointer to the published buffer would not stay
+    // valid for a whole loop pass: MQTT messages are handled in the
+    // middle of it, and the second publish reuses the buffer it points to.
     ConfigData config = {};
+    bool snapshot();
+    void set(const ConfigData &data);
     void save();
+    void requestSave();
+    bool flush();
     void load();
+    bool loadBinary();
+    bool loadJSON();
     void configToJSON(JsonDocument &doc, bool skipSensitiveData = false);
+    void writeJSON(Print &out);
+    void putJSON(const char *body, size_t length, Print &out);
+    bool patchJSON(const char *body, size_t length, JsonDocument &changes);
+    static size_t patchCapacity(size_t length);
     bool JSONToConfig(JsonDocument &doc, bool skipSensitiveData = false);
-    bool locked = false;
+    bool JSONPatchToConfig(JsonDocument &doc, JsonDocument &changes, bool skipSensitiveData = false);
+    bool setField(const char *name, const char *value);
+    static const char *fieldName(uint8_t index);
+    uint32_t fieldValue(uint8_t index);
     bool forceReset = false;
-    bool tainted = false;
+    uint16_t dirty = 0;
+    uint32_t saveCount = 0;
+    uint32_t writeCount = 0;
+    uint32_t lastSaveDuration = 0; // µs
+    bool savePending = false;
+    uint32_t generation = 0; // counts published configs
 
 private:
+    ConfigData _buffers[2] = {};
+    ConfigData *_published = &_buffers[0];
+    uint32_t _snapshotGeneration = 0;
+    ConfigData *_inactive();
+    ConfigData &_edit();
+    void _publish(ConfigData &data);
+    bool _loadBinary(const char *path);
     bool _resetRequest = false;
+    uint32_t _firstSaveRequest = 0;
+    uint32_t _lastSaveRequest = 0;
     uint8_t _validateInt(uint8_t val, uint8_t min, uint8_t max);
+    bool _readJSON(JsonDocument &doc, JsonDocument *changes, bool skipSensitiveData);
 };
 
 #endif //config_h
\ No newline at end of file
@@ -0,0 +1,192 @@
+#ifndef effect_h
+#define effect_h
+#include <NeoPixelBus.h>
+
+#define ANIMATION_LAYERS 2           // clock strip and backlight
+#define ANIMATION_NIGHT_BRIGHTNESS 25 // of 255, about a tenth like the dimmed colors
+
+// An animation drawn from one period of a pattern. The pattern is built
+// once, moving it along the strip only changes the offset it is copied
+// to the pixels at, so the cost per frame is two memcpy calls for any
+// strip length. Effects that change over time can also alter their
+// pattern in update().
+class Effect
+{
+public:
+    virtual ~Effect() {}
+
+    // Fills the pattern with length pixels in the wire order of the strip
+    virtual void build(uint8_t *pattern, uint16_t length, uint8_t brightness) = 0;
+
+    // Changes the pattern for the phase in ms since the effect started,
+    // returns true if it did
+    virtual bool update(uint8_t * /* pattern */, uint16_t /* length */, uint32_t /* phase */)
+    {
+        return false;
+    }
+
+    // Pixels per second the pattern moves along the strip
+    virtual uint16_t speed() const
+    {
+        return 30;
+    }
+};
+
+// Colors of a full turn of the hue circle at full brightness, computed
+// once so building patterns needs no float conversions
+class HuePalette
+{
+public:
+    RgbColor color(uint8_t index)
+    {
+        if (!_built)
+        {
+            for (uint16_t i = 0; i < 256; i++)
+            {
+                _colors[i] = HsbColor(i / 256.0f, 1.0f, 1.0f);
+            }
+            _built = true;
+        }
+        return _colors[index];
+    }
+
+private:
+    RgbColor _colors[256];
+    bool _built = false;
+};
+
+HuePalette huePalette;
+
+static RgbColor _dimmed(RgbColor color, uint8_t brightness)
+{
+    return brightness == 255 ? color : color.Dim(brightness);
+}
+
+// Every fourth LED red
+class AlarmEffect : public Effect
+{
+public:
+    void build(uint8_t *pattern, uint16_t length, uint8_t brightness) override
+    {
+        RgbColor red = _dimmed(RgbColor(255, 0, 0), brightness);
+        for (uint16_t i = 0; i < length; i++)
+        {
+            NeoGrbFeature::applyPixelColor(pattern, i, i % 4 == 0 ? red : off);
+        }
+    }
+};
+
+// The hue circle once around the strip
+class RainbowEffect : public Effect
+{
+public:
+    void build(uint8_t *pattern, uint16_t length, uint8_t brightness) override
+    {
+        for (uint16_t i = 0; i < length; i++)
+        {
+            RgbColor color = huePalette.color((uint32_t)i * 256 / length);
+            NeoGrbFeature::applyPixelColor(pattern, i, _dimmed(color, brightness));
+        }
+    }
+};
+
+AlarmEffect alarmEffect;
+RainbowEffect rainbowEffect;
+
+// Plays an effect on the strips. The phase follows the time since the
+// effect started, so it moves at the same speed with any frame rate.
+class Animation
+{
+public:
+    ~Animation()
+    {
+        stop();
+    }
+
+    // Starts effect unless it is playing already. Switching between day
+    // and night rebuilds the patterns but keeps the phase.
+    void play(Effect &effect, bool night, uint32_t now)
+    {
+        uint8_t brightness = night ? ANIMATION_NIGHT_BRIGHTNESS : 255;
+        if (&effect == _effect && brightness == _brightness)
+        {
+            return;
+        }
+        if (&effect != _effect)
+        {
+            _start = now;
+        }
+        _effect = &effect;
+        _brightness = brightness;
+        for (Layer &layer : _layers)
+        {
+            layer.built = false;
+        }
+    }
+
+    void stop()
+    {
+        _effect = nullptr;
+        for (Layer &layer : _layers)
+        {
+            delete[] layer.pattern;
+            layer = Layer();
+        }
+    }
+
+    // Writes the current frame of a layer into pixels, returns false if
+    // they already show it
+    bool render(uint8_t index, uint8_t *pixels, uint16_t length, uint32_t now)
+    {
+        if (_effect == nullptr || length == 0)
+        {
+            return false;
+        }
+        Layer &layer = _layers[index];
+        bool changed = false;
+        if (layer.length != length)
+        {
+            delete[] layer.pattern;
+            layer.pattern = new uint8_t[length * NeoGrbFeature::PixelSize];
+            layer.length = length;
+            layer.built = false;
+        }
+        if (!layer.built)
+        {
+            _effect->build(layer.pattern, length, _brightness);
+            layer.built = true;
+            changed = true;
+        }
+        uint32_t phase = now - _start;
+        changed |= _effect->update(layer.pattern, length, phase);
+        uint16_t offset = (uint64_t)phase * _effect->speed() / 1000 % length;
+        if (!changed && offset == layer.offset)
+        {
+            return false;
+        }
+        layer.offset = offset;
+
+        // pixel i shows pattern pixel i - offset
+        size_t head = (size_t)(length - offset) * NeoGrbFeature::PixelSize;
+        memcpy(pixels + offset * NeoGrbFeature::PixelSize, layer.pattern, head);
+        memcpy(pixels, layer.pattern + head, offset * NeoGrbFeature::PixelSize);
+        return true;
+    }
+
+private:
+    struct Layer
+    {
+        uint8_t *pattern = nullptr;
+        uint16_t length = 0;
+        int32_t offset = -1;
+        bool built = false;
+    };
+    Layer _layers[ANIMATION_LAYERS];
+    Effect *_effect = nullptr;
+    uint8_t _brightness = 255;
+    uint32_t _start = 0;
+};
+
+Animation animation;
+
+#endif //effect_h
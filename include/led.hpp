@@ -1,6 +1,19 @@
 #ifndef led_h
 #define led_h
 #include <NeoPixelBus.h>
+#include "compositor.hpp"
+
+// FNV-1a over the raw pixel buffer, used to detect unchanged frames
+uint32_t frameHash(const uint8_t *pixels, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= pixels[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
 void initStrip()
 {
@@ -8,6 +21,10 @@ void initStrip()
     {
         delete strip;
     }
+    if (bgStrip != NULL)
+    {
+        delete bgStrip;
+    }
 #if defined(ESP8266)
 #if defined(UART_MODE)
     strip = new NeoPixelBus<NeoGrbFeature, NeoEsp8266Uart1800KbpsMethod>(config.config.ledCount, config.config.ledPin);
@@ -25,39 +42,103 @@ void initStrip()
 #elif defined(ESP32)
     strip = new NeoPixelBus<NeoGrbFeature, NeoEsp32BitBangWs2812xMethod>(config.config.ledCount, config.config.ledPin);
     bgStrip = new NeoPixelBus<NeoGrbFeature, NeoEsp32BitBangWs2812xMethod>(config.config.bgLedCount, config.config.bgLedPin);
+#elif defined(NATIVE_BUILD)
+    strip = new NeoPixelBus<NeoGrbFeature, NeoNativeMethod>(config.config.ledCount, config.config.ledPin);
+    bgStrip = new NeoPixelBus<NeoGrbFeature, NeoNativeMethod>(config.config.bgLedCount, config.config.bgLedPin);
 #endif
     strip->Begin();
     strip->ClearTo(off);
     strip->Show();
+    stripHash = frameHash(strip->Pixels(), strip->PixelsSize());
     bgStrip->Begin();
     bgStrip->ClearTo(off);
     bgStrip->Show();
+    bgStripHash = frameHash(bgStrip->Pixels(), bgStrip->PixelsSize());
+    compositor.invalidate(LAYERS_ALL);
+}
+
+// Blends color onto current in HSB space. Kept for reference and for
+// builds with FLOAT_BLEND set.
+RgbColor blendColorsHsb(const RgbColor &current, const RgbColor &color)
+{
+    HsbColor currentColor(current);
+    HsbColor sourceColor(color);
+    HsbColor targetColor;
+    float targetBlend = sourceColor.B;
+    float targetBrightness = max(currentColor.B, sourceColor.B);
+    float targetSaturation = max(currentColor.S, sourceColor.S);
+    if (targetSaturation == 0)
+    {
+        currentColor.H = sourceColor.H;
+    }
+    targetColor = RgbColor::LinearBlend(currentColor, sourceColor, targetBlend);
+    targetColor.B = targetBrightness;
+    return targetColor;
+}
+
+uint32_t packColor(const RgbColor &color)
+{
+    return (uint32_t)color.R << 16 | (uint32_t)color.G << 8 | color.B;
 }
 
-void setPixel(uint8_t pos, HsbColor color, bool blend = true)
+RgbColor unpackColor(uint32_t color)
 {
-    if (color.B == 0)
+    return RgbColor(color >> 16, color >> 8, color);
+}
+
+uint8_t maxChannel(uint32_t color)
+{
+    uint8_t r = color >> 16, g = color >> 8, b = color;
+    return max(r, max(g, b));
+}
+
+// Fixed point version of blendColorsHsb() on 0x00RRGGBB words. Red and blue
+// share one 32 bit multiply, green gets its own. The HSB brightness of a
+// color is its largest channel, so the result is the linear blend weighted
+// by the source brightness, scaled up until its largest channel matches the
+// brighter of both inputs. Blending in RGB keeps the hue of the colored
+// input when the other one is unsaturated.
+uint32_t blendColorsFixed(uint32_t current, uint32_t color)
+{
+    uint8_t sourceBrightness = maxChannel(color);
+    uint8_t targetBrightness = max(maxChannel(current), sourceBrightness);
+    uint32_t alpha = sourceBrightness + (sourceBrightness >> 7);
+
+    uint32_t rb = ((current & 0xFF00FF) * (256 - alpha) + (color & 0xFF00FF) * alpha) >> 8;
+    uint32_t g = ((current & 0x00FF00) * (256 - alpha) + (color & 0x00FF00) * alpha) >> 8;
+    uint32_t blended = (rb & 0xFF00FF) | (g & 0x00FF00);
+
+    uint8_t blendedBrightness = maxChannel(blended);
+    if (blendedBrightness == 0)
+    {
+        return color;
+    }
+    // rounded up so the brightest channel lands exactly on targetBrightness,
+    // no channel can exceed 0xFF so the lanes never overflow
+    uint32_t scale = ((uint32_t)targetBrightness * 256 + blendedBrightness - 1) / blendedBrightness;
+    rb = (((blended & 0xFF00FF) * scale) >> 8) & 0xFF00FF;
+    g = (((blended & 0x00FF00) * scale) >> 8) & 0x00FF00;
+    return rb | g;
+}
+
+void setPixel(uint16_t pos, RgbColor color, bool blend = true)
+{
+    if (color.R == 0 && color.G == 0 && color.B == 0)
         return;
     if (blend)
     {
-        HsbColor currentColor = strip->GetPixelColor(pos);
-        if (currentColor.B == 0)
+        RgbColor currentColor = strip->GetPixelColor(pos);
+        if (currentColor.R == 0 && currentColor.G == 0 && currentColor.B == 0)
         {
             strip->SetPixelColor(pos, color);
         }
         else
         {
-            HsbColor targetColor;
-            float targetBlend = color.B;
-            float targetBrightness = max(currentColor.B, color.B);
-            float targetSaturation = max(currentColor.S, color.S);
-            if (targetSaturation == 0)
-            {
-                currentColor.H = color.H;
-            }
-            targetColor = RgbColor::LinearBlend(currentColor, color, targetBlend);
-            targetColor.B = targetBrightness;
-            strip->SetPixelColor(pos, targetColor);
+#if defined(FLOAT_BLEND)
+            strip->SetPixelColor(pos, blendColorsHsb(currentColor, color));
+#else
+            strip->SetPixelColor(pos, unpackColor(blendColorsFixed(packColor(currentColor), packColor(color))));
+#endif
         }
     }
     else
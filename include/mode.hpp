@@ -0,0 +1,36 @@
+#ifndef mode_h
+#define mode_h
+#include <Arduino.h>
+
+// What the clock face shows, chosen by the alarm, a realtime pixel
+// stream, the top of the hour light or a command received over MQTT
+enum ClockMode : uint8_t
+{
+    MODE_TIME,
+    MODE_ALARM,
+    MODE_RAINBOW,
+    MODE_OFF,
+    MODE_REALTIME,
+    MODE_COUNT
+};
+
+static const char *const modeNames[MODE_COUNT] = {"time", "alarm", "rainbow", "off", "realtime"};
+
+// Published as status whenever one of the fields changes
+struct ClockState
+{
+    ClockMode mode;
+    bool night;
+    bool alarm;
+
+    bool operator==(const ClockState &other) const
+    {
+        return mode == other.mode && night == other.night && alarm == other.alarm;
+    }
+    bool operator!=(const ClockState &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+#endif //mode_h
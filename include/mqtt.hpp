@@ -12,6 +12,21 @@
 
 #include <PubSubClient.h>
 #include "config.hpp"
+#include "backoff.hpp"
+#include "mode.hpp"
+#include "resolver.hpp"
+#include "tcpclient.hpp"
+
+// Reconnect delays after failed attempts, how long the TCP connect of an
+// attempt may take once the broker address is known, and how long
+// PubSubClient then waits for the broker to accept the login
+#define MQTT_RETRY_MIN_MS 1000
+#define MQTT_RETRY_MAX_MS 60000
+#define MQTT_CONNECT_TIMEOUT_MS 1500
+#define MQTT_HANDSHAKE_TIMEOUT_S 1
+
+#define MQTT_FIELDS_PER_PASS 4 // retained field topics published per loop pass
+#define MQTT_ALL_FIELDS ((1ULL << CONFIG_FIELD_COUNT) - 1)
 
 class Mqtt
 {
@@ -19,10 +34,15 @@ class Mqtt
 public:
     Mqtt();
     bool setup(Config &config);
-    void publish(const char *message, const char *topic, bool retain = false);
+    bool reconfigure(Config &config);
+    bool publish(const char *message, const char *topic, bool retain = false);
     bool connect(Config &config);
+    bool connected();
     void publishConfig(Config &config);
+    void publishConfigChanges(JsonDocument &changes);
     void publishStatus(const char *status);
+    void publishState(const ClockState &state);
+    void publishFields(Config &config);
 #ifdef DEBUG_BUILD
     void publishUptime();
 #endif
@@ -33,16 +53,40 @@ public:
 #ifdef DEBUG_BUILD
     char debugTopic[255] = {0};
 #endif
+    char stateTopic[255] = {0};
     char setConfigTopic[255] = {0};
-    char currentCommand[32];
+    char patchConfigTopic[255] = {0};
+    char configChangesTopic[255] = {0};
+    char setFieldTopic[255] = {0}; // prefix, the field name follows it
+    ClockMode command = MODE_TIME;
+    uint32_t connectCount = 0;
+    uint32_t connectAttempts = 0;
+    uint32_t connectFailures = 0;
+    uint32_t lastConnect = 0; // millis() of the last successful connect
 
 private:
     void _handleRequest(char *topic, byte *payload, unsigned int length, Config &config);
-    WiFiClient _wifiClient = WiFiClient();
+    void _advance();
+    void _onConnected(Config &config);
+    void _failed();
+    Resolver _resolver;
+    TcpClient _tcp;
+    bool _resolving = false;    // an attempt waits for the broker address
+    bool _connecting = false;   // an attempt waits for the TCP connect
+    uint32_t _connectStart = 0; // millis() the TCP connect started
+    Config *_config = nullptr;
     WiFiClientSecure _wifiClientSecure = WiFiClientSecure();
     PubSubClient _mqttClient = PubSubClient();
     char _lastStatus[32] = {0};
+    ClockState _lastState = {};
+    bool _statePublished = false;
+    void _publishFields();
+    uint32_t _fieldValues[CONFIG_FIELD_COUNT] = {};
+    uint64_t _fieldsUnsent = MQTT_ALL_FIELDS; // fields not published since connecting
+    uint8_t _fieldCursor = 0;                 // field the next pass starts with
+    bool _fieldsPending = false;
     bool _isEnabled = false;
+    Backoff _backoff = Backoff(MQTT_RETRY_MIN_MS, MQTT_RETRY_MAX_MS);
 };
 
 #endif // mqtt_h
@@ -0,0 +1,55 @@
+#ifndef ntp_h
+#define ntp_h
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include "stats.hpp"
+#include "wallclock.hpp"
+
+#define NTP_PORT 123
+#define NTP_PACKET_SIZE 48
+#define NTP_TIMEOUT_US 1500000       // a reply arriving later is ignored
+#define NTP_RETRY_US 16000000        // after a timeout or before the first sync
+#define NTP_INTERVAL_US 1024000000   // between requests once synced
+#define NTP_STEP_THRESHOLD_US 128000 // larger offsets step the time instead of slewing it
+#define NTP_RESOLVE_TIMEOUTS 3       // timeouts in a row after which the server may have moved
+
+// Results of NtpClient::poll()
+#define NTP_NONE 0
+#define NTP_SLEWED 1  // the wall clock is being corrected
+#define NTP_STEPPED 2 // the wall clock jumped to the server time
+
+// SNTP client that never waits for the network. poll() sends a request
+// when one is due and otherwise only looks whether the reply arrived, so
+// a lost packet costs a timeout counter and not a frozen clock. Replies
+// correct the wall clock, by slewing unless it is off by more than
+// NTP_STEP_THRESHOLD_US. The server is given as an address, the owner
+// looks up its name and looks it up again once needsResolve() tells that
+// the server stopped answering.
+class NtpClient
+{
+public:
+    NtpClient(WallClock &clock);
+    void begin(IPAddress server, uint16_t port = NTP_PORT);
+    bool started() const { return _server != 0; }
+    bool needsResolve() const { return _timeoutsInRow >= NTP_RESOLVE_TIMEOUTS; }
+    uint8_t poll(uint32_t now);
+    NtpStats stats;
+
+private:
+    void _send(uint32_t now);
+    uint8_t _receive(uint32_t now);
+    uint8_t _apply(int64_t offset, uint32_t now);
+    WiFiUDP _udp;
+    WallClock &_clock;
+    uint32_t _server = 0;
+    uint16_t _port = NTP_PORT;
+    bool _waiting = false;
+    uint8_t _timeoutsInRow = 0;
+    uint32_t _sent = 0;       // micros() the request was sent
+    uint32_t _due = 0;        // micros() the next request is due
+    uint64_t _originate = 0;  // transmit timestamp of the request, in NTP format
+    uint32_t _lastSample = 0; // micros() of the last reply
+    bool _sampled = false;
+};
+
+#endif //ntp_h
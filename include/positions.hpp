@@ -0,0 +1,68 @@
+#ifndef positions_h
+#define positions_h
+#include "config.hpp"
+
+// Lookup tables that map the 60 logical positions of the clock face onto
+// the LEDs of the strip. They only change with ledRoot or the number of
+// LEDs forming the face, so they are rebuilt on config changes and the
+// render functions just index into them.
+struct Positions
+{
+    uint16_t count;             // LEDs forming the clock face
+    uint16_t led[60];           // LED of each logical position
+    uint16_t following[60];     // LED of the next logical position
+    uint16_t before[60];        // LED a logical position left of led[i]
+    uint16_t after[60];         // LED a logical position right of led[i]
+    uint8_t hourBase[24];       // logical position of each full hour
+    uint8_t hourProgress[60];   // hour hand advance for each minute
+    uint16_t dot[12];           // LED of each hour dot
+    uint16_t segmentStart[24];  // first LED of each hour's segment
+    uint16_t segmentLength[24]; // LEDs in each hour's segment
+};
+
+Positions positions;
+
+void buildPositions(const ConfigData &data)
+{
+    uint16_t count = min(data.clockLedCount, data.ledCount);
+    if (count == 0)
+    {
+        count = 1;
+    }
+    uint16_t root = data.ledRoot % count;
+    positions.count = count;
+
+    // spread the logical positions evenly over the face
+    uint16_t ring[61];
+    for (uint16_t i = 0; i <= 60; i++)
+    {
+        ring[i] = (i * count + 30) / 60;
+    }
+
+    for (uint8_t i = 0; i < 60; i++)
+    {
+        positions.led[i] = (ring[i] + root) % count;
+        positions.hourProgress[i] = i / 12;
+    }
+    for (uint8_t i = 0; i < 60; i++)
+    {
+        positions.following[i] = positions.led[(i + 1) % 60];
+        // at least the LED next to it on faces of less than 60 LEDs
+        uint16_t shift = max((count + 30) / 60, 1);
+        positions.before[i] = (positions.led[i] + count - shift) % count;
+        positions.after[i] = (positions.led[i] + shift) % count;
+    }
+    for (uint8_t i = 0; i < 24; i++)
+    {
+        uint8_t hour12 = i % 12;
+        positions.hourBase[i] = hour12 * 5;
+        positions.segmentStart[i] = positions.led[hour12 * 5];
+        positions.segmentLength[i] = ring[(hour12 + 1) * 5] - ring[hour12 * 5];
+    }
+    for (uint8_t i = 0; i < 12; i++)
+    {
+        positions.dot[i] = positions.led[i * 5];
+    }
+}
+
+#endif //positions_h
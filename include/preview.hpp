@@ -0,0 +1,54 @@
+#ifndef preview_h
+#define preview_h
+#include <Arduino.h>
+
+#define PREVIEW_PORT 81
+#define PREVIEW_CLIENTS 2
+#define PREVIEW_KEYFRAME 0x01
+#define PREVIEW_HEADER_SIZE 5
+#define PREVIEW_RUN_SIZE 3
+
+// Encodes the shown strip pixels for the live preview of the web
+// interface. Every client gets the pixels that changed since the last
+// frame it received:
+//
+//   u8 flags, u16 pixel count, u16 background pixel count, then runs of
+//   u16 first pixel, u8 pixel count and the RGB values of the run
+//
+// all little endian. The background pixels continue after the clock
+// pixels. A client gets the next frame only after it has acknowledged
+// the previous one with any message, so a slow connection receives fewer
+// frames instead of queueing them up.
+class Preview
+{
+public:
+    Preview();
+    ~Preview();
+    bool connect(uint8_t id);
+    void disconnect(uint8_t id);
+    void ready(uint8_t id);
+    int16_t client(uint8_t slot) const;
+    size_t encode(uint8_t slot, const uint8_t *pixels, uint16_t count, const uint8_t *bgPixels, uint16_t bgCount);
+    const uint8_t *message() const
+    {
+        return _message;
+    }
+    uint32_t framesSent = 0;
+    uint32_t bytesSent = 0;
+
+private:
+    struct Client
+    {
+        bool connected;
+        bool ready;
+        uint8_t id;
+        uint8_t *shadow; // the pixels last sent, in wire order
+        size_t size;
+    };
+    int8_t _find(uint8_t id) const;
+    Client _clients[PREVIEW_CLIENTS] = {};
+    uint8_t *_message = nullptr;
+    size_t _messageSize = 0;
+};
+
+#endif //preview_h
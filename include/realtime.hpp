@@ -0,0 +1,63 @@
+#ifndef realtime_h
+#define realtime_h
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include "stats.hpp"
+
+#define REALTIME_DDP_PORT 4048
+#define REALTIME_E131_PORT 5568
+#define REALTIME_E131_UNIVERSE 1   // first universe, the following ones continue the pixels
+#define REALTIME_E131_UNIVERSES 8  // 170 pixels each
+#define REALTIME_SLOTS 4           // frames in the jitter buffer, one of them is being received
+#define REALTIME_PREBUFFER 2       // complete frames held back before playing starts
+#define REALTIME_TIMEOUT_MS 2500   // without frames the clock shows the time again
+#define REALTIME_MAX_PACKET 1460
+
+// Receives pixel frames over UDP as DDP or E1.31 (sACN) and plays them
+// out on the frame ticks of the loop. The pixels of the clock strip come
+// first, the background strip continues after them.
+//
+// Packets are parsed in the receive buffer and their pixels are written
+// straight into a slot of the jitter buffer in the wire order of the
+// strips, so showing a frame is a plain copy of the slot into the pixel
+// buffers. The buffer is only allocated while a stream is running.
+// Senders have to send complete frames, a slot still holds an older
+// frame when it gets reused.
+class Realtime
+{
+public:
+    Realtime();
+    ~Realtime();
+    void begin();
+    void resize(uint16_t pixelCount, uint16_t bgPixelCount);
+    void receive(uint32_t now);
+    bool ingestDDP(const uint8_t *packet, size_t length, uint32_t now);
+    bool ingestE131(const uint8_t *packet, size_t length, uint32_t now);
+    bool active(uint32_t now) const;
+    bool present(uint8_t *pixels, uint8_t *bgPixels, uint32_t now);
+    RealtimeStats stats;
+
+private:
+    void _writePixels(size_t offset, const uint8_t *data, size_t length);
+    void _completeFrame(uint32_t now);
+    void _release();
+    WiFiUDP _ddp;
+    WiFiUDP _e131;
+    uint8_t _packet[REALTIME_MAX_PACKET];
+    uint8_t *_slots = nullptr;
+    size_t _frameSize = 0;
+    uint16_t _pixelCount = 0;
+    uint16_t _bgPixelCount = 0;
+    uint8_t _writeSlot = 0;
+    uint8_t _readSlot = 0;
+    uint8_t _ready = 0;      // complete frames waiting to be shown
+    bool _receiving = false; // the write slot holds part of a frame
+    bool _streaming = false; // a frame was completed since the last release
+    bool _playing = false;   // done prebuffering
+    uint32_t _lastFrame = 0;  // millis() of the last complete frame
+    uint32_t _lastPacket = 0; // millis() of the last packet with pixels
+    uint8_t _ddpSequence = 0;
+    int16_t _e131Sequence[REALTIME_E131_UNIVERSES];
+};
+
+#endif //realtime_h
@@ -0,0 +1,269 @@
+#ifndef render_h
+#define render_h
+#include <NeoPixelBus.h>
+#include <ezTime.h>
+#include "config.hpp"
+#include "led.hpp"
+#include "positions.hpp"
+#include "effect.hpp"
+#include "compositor.hpp"
+
+void renderSecondsHand(int s)
+{
+    setPixel(positions.led[s], secondColor, config.config.blendColors);
+}
+
+// Milliseconds since the current second began, at the start of the frame
+uint16_t secondPhase()
+{
+    return min((frameStats.frameStart - secondStart) / 1000, (uint32_t)999);
+}
+
+RgbColor scaleColor(const RgbColor &color, uint16_t weight)
+{
+    return RgbColor(color.R * weight >> 8, color.G * weight >> 8, color.B * weight >> 8);
+}
+
+// Draws a hand that is phase ms into a turn of period ms. It lies between
+// two LEDs of the face, which share its color in 1/256 by how close it is
+// to each, so it moves with the time passed and not with the frames
+// rendered. offset moves it by logical positions, 1/60 of the face, and
+// by at least one LED.
+void renderSmoothHand(uint32_t phase, uint32_t period, int8_t offset, const RgbColor &color)
+{
+    uint16_t count = positions.count;
+    uint32_t position = (uint64_t)phase * count * 256 / period;
+    uint16_t fraction = position & 0xFF;
+    int16_t shift = offset * max((count + 30) / 60, 1);
+    uint16_t led = ((position >> 8) + positions.led[0] + count + shift) % count;
+    setPixel(led, scaleColor(color, 256 - fraction), config.config.blendColors);
+    setPixel((led + 1) % count, scaleColor(color, fraction), config.config.blendColors);
+}
+
+void renderSmoothHands()
+{
+    uint32_t second = currentSecond * 1000 + secondPhase();
+    uint32_t minute = currentMinute * 60000 + second;
+    uint32_t hour = (currentHour % 12) * 3600000 + minute;
+
+    if (strcmp(config.config.hourHandStyle, "split") == 0)
+    {
+        renderSmoothHand(hour, 43200000, -1, hourColor);
+        renderSmoothHand(hour, 43200000, 1, hourColor);
+    }
+    else if (strcmp(config.config.hourHandStyle, "wide") == 0)
+    {
+        RgbColor dim = hourColor.Dim(32);
+        renderSmoothHand(hour, 43200000, -1, dim);
+        renderSmoothHand(hour, 43200000, 0, hourColor);
+        renderSmoothHand(hour, 43200000, 1, dim);
+    }
+    else
+    {
+        renderSmoothHand(hour, 43200000, 0, hourColor);
+    }
+    renderSmoothHand(minute, 3600000, 0, minuteColor);
+    renderSmoothHand(second, 60000, 0, secondColor);
+}
+
+uint16_t calculateMinuteHand(int m)
+{
+    return positions.led[m];
+}
+
+void renderHourHand(int h, int m)
+{
+    uint8_t hourPosition = positions.hourBase[h] + positions.hourProgress[m];
+    uint16_t hourHand = positions.led[hourPosition];
+    uint16_t nextPixel = positions.after[hourPosition];
+    uint16_t prevPixel = positions.before[hourPosition];
+
+    if (strcmp(config.config.hourHandStyle, "split") == 0)
+    {
+        setPixel(prevPixel, hourColor, config.config.blendColors);
+        setPixel(nextPixel, hourColor, config.config.blendColors);
+    }
+    else if (strcmp(config.config.hourHandStyle, "wide") == 0)
+    {
+        RgbColor dim = hourColor.Dim(32);
+        setPixel(prevPixel, dim, config.config.blendColors);
+        setPixel(hourHand, hourColor, config.config.blendColors);
+        setPixel(nextPixel, dim, config.config.blendColors);
+    }
+    else
+    {
+        setPixel(hourHand, hourColor, config.config.blendColors);
+    }
+}
+
+uint16_t calculateDayHand()
+{
+    return config.config.dayOffset + wallClock.day() - 1;
+}
+
+uint16_t calculateMonthHand()
+{
+    return config.config.monthOffset + wallClock.month() - 1;
+}
+
+uint16_t calculateWeekdayHand()
+{
+    // weekdays count from 1 for monday to 7 for sunday
+    return config.config.weekdayOffset + wallClock.weekday() - 1;
+}
+
+void renderHourDots()
+{
+    for (size_t i = 0; i < 12; i++)
+    {
+        uint16_t dotPos = positions.dot[i];
+        if (i % 3 == 0 && config.config.hourQuarter)
+        {
+            strip->SetPixelColor(dotPos, quarter);
+        }
+        else if (config.config.hourDot)
+        {
+            strip->SetPixelColor(dotPos, dot);
+        }
+    }
+}
+
+void renderHourSegment(uint8_t h)
+{
+    uint16_t pos = positions.segmentStart[h];
+    for (size_t i = 0; i < positions.segmentLength[h]; i++)
+    {
+        strip->SetPixelColor(pos, segment);
+        // the segment wraps around at the end of the face
+        if (++pos == positions.count)
+        {
+            pos = 0;
+        }
+    }
+}
+
+// Fills the backlight, it is only drawn again when its color changed
+void setBacklight()
+{
+    if (!compositor.pending(LAYER_BIT(LAYER_BACKGROUND)))
+        return;
+    uint8_t *background = compositor.cache(LAYER_BACKGROUND, bgStrip->PixelsSize());
+    if (compositor.dirty(LAYER_BACKGROUND))
+    {
+        bgStrip->ClearTo(off);
+        for (size_t i = 0; i < config.config.bgLedCount; i++)
+        {
+            bgStrip->SetPixelColor(i, bgColor);
+        }
+        memcpy(background, bgStrip->Pixels(), bgStrip->PixelsSize());
+    }
+    else
+    {
+        memcpy(bgStrip->Pixels(), background, bgStrip->PixelsSize());
+        bgStrip->Dirty();
+    }
+    compositor.done(LAYER_BIT(LAYER_BACKGROUND));
+}
+
+void showStrips()
+{
+    // only send a strip if its pixels differ from what was last shown,
+    // the time display needs no hash to know it did not change
+    uint32_t hash;
+    if (!compositor.unchanged(LAYERS_CLOCK) &&
+        (hash = frameHash(strip->Pixels(), strip->PixelsSize())) != stripHash)
+    {
+        while (!strip->CanShow())
+        {
+            delay(1);
+        }
+        strip->Show();
+        stripHash = hash;
+    }
+    else
+    {
+        skippedFrames++;
+    }
+    compositor.shown(LAYERS_CLOCK);
+
+    if (!compositor.unchanged(LAYER_BIT(LAYER_BACKGROUND)) &&
+        (hash = frameHash(bgStrip->Pixels(), bgStrip->PixelsSize())) != bgStripHash)
+    {
+        while (!bgStrip->CanShow())
+        {
+            delay(1);
+        }
+        bgStrip->Show();
+        bgStripHash = hash;
+    }
+    else
+    {
+        skippedBgFrames++;
+    }
+    compositor.shown(LAYER_BIT(LAYER_BACKGROUND));
+}
+void clearStrips()
+{
+    strip->ClearTo(off);
+    bgStrip->ClearTo(off);
+    compositor.recompose();
+}
+
+// Plays effect on the clock strip, and on the backlight if it is on
+void renderAnimation(Effect &effect)
+{
+    uint32_t now = millis();
+    animation.play(effect, night, now);
+    if (animation.render(0, strip->Pixels(), strip->PixelCount(), now))
+        strip->Dirty();
+    if (config.config.bgLight && animation.render(1, bgStrip->Pixels(), bgStrip->PixelCount(), now))
+        bgStrip->Dirty();
+}
+
+// Composes the clock face if any of its layers changed. The markers are
+// drawn once per hour or color change and copied from their cache on the
+// other frames, the few pixels of the hands and the date go on top.
+void renderTime()
+{
+    // smooth hands move with every frame
+    if (config.config.fluidMotion)
+        compositor.invalidate(LAYER_BIT(LAYER_HANDS));
+    if (!compositor.pending(LAYERS_CLOCK))
+        return;
+
+    uint8_t *markers = compositor.cache(LAYER_MARKERS, strip->PixelsSize());
+    if (compositor.dirty(LAYER_MARKERS))
+    {
+        strip->ClearTo(off);
+        if (config.config.hourDot)
+            renderHourDots();
+        if (config.config.hourSegment)
+            renderHourSegment(currentHour);
+        memcpy(markers, strip->Pixels(), strip->PixelsSize());
+    }
+    else
+    {
+        memcpy(strip->Pixels(), markers, strip->PixelsSize());
+        strip->Dirty();
+    }
+
+    if (config.config.fluidMotion)
+    {
+        renderSmoothHands();
+    }
+    else
+    {
+        renderHourHand(currentHour, currentMinute);
+        setPixel(calculateMinuteHand(currentMinute), minuteColor, config.config.blendColors);
+        renderSecondsHand(currentSecond);
+    }
+    if (config.config.dayMonth)
+    {
+        setPixel(currentDayPos, dayColor, config.config.blendColors);
+        setPixel(currentMonthPos, monthColor, config.config.blendColors);
+        setPixel(currentWeekdayPos, weekdayColor, config.config.blendColors);
+    }
+    compositor.done(LAYERS_CLOCK);
+}
+
+#endif //render_h
\ No newline at end of file
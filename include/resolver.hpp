@@ -0,0 +1,46 @@
+#ifndef resolver_h
+#define resolver_h
+#include <Arduino.h>
+#if defined(ESP8266)
+#include <ESP8266WiFi.h>
+#include <lwip/dns.h>
+#elif defined(ESP32)
+#include <WiFi.h>
+#include <lwip/dns.h>
+#else
+#include <IPAddress.h>
+#endif
+
+#define RESOLVER_TIMEOUT_MS 5000
+
+// Results of Resolver::poll()
+#define RESOLVE_IDLE 0
+#define RESOLVE_PENDING 1
+#define RESOLVE_DONE 2
+#define RESOLVE_FAILED 3
+
+// Looks up a host name without waiting for the answer. begin() hands the
+// name to the DNS client of lwIP, poll() tells whether its answer came.
+// Addresses and names still in the DNS cache resolve right away. The
+// native build only understands addresses.
+class Resolver
+{
+public:
+    void begin(const char *host, uint32_t now);
+    uint8_t poll(uint32_t now);
+    IPAddress address() const { return IPAddress(_address); }
+
+private:
+#ifndef NATIVE_BUILD
+    static void _found(const char *name, const ip_addr_t *address, void *arg);
+#endif
+    void _start();
+    char _host[64] = "";
+    uint8_t _state = RESOLVE_IDLE;
+    bool _restart = false;           // begin() came while lwIP still had a lookup
+    volatile bool _inFlight = false; // lwIP calls _found() once per lookup
+    volatile uint32_t _address = 0;  // network byte order, 0 if not found
+    uint32_t _started = 0;           // millis() of begin()
+};
+
+#endif //resolver_h
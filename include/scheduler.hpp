@@ -0,0 +1,63 @@
+#ifndef scheduler_h
+#define scheduler_h
+#include <Arduino.h>
+#include <functional>
+#include "config.hpp"
+
+#define SCHEDULE_NEVER 0xFFFFFFFF
+#define SCHEDULE_SEARCH_WEEKS 53 // how far ahead daylight saving time changes are looked for
+
+// Events in the order they fire when they fall on the same second
+enum ScheduleEvent : uint8_t
+{
+    EVENT_DST,   // the offset of the time zone changed
+    EVENT_NIGHT, // night time began or ended
+    EVENT_ALARM, // the alarm minute began or ended
+    EVENT_COUNT
+};
+
+// Knows when the next change of the time zone offset, of night time and of
+// the alarm is due, as UTC timestamps. update() only compares the time
+// against the earliest of them and calls the handlers of the events that
+// are due, which then read the new state from night(), alarm() and
+// offset(). plan() computes everything again and calls all handlers, it
+// is needed when the settings or the time changed.
+class Scheduler
+{
+public:
+    typedef int32_t (*ZoneOffset)(uint32_t utc); // seconds local time is ahead of UTC
+
+    void setZone(ZoneOffset zoneOffset);
+    void on(ScheduleEvent event, std::function<void()> handler);
+    void plan(const ConfigData &config, uint32_t utc);
+    void update(uint32_t utc)
+    {
+        if (utc >= _due)
+        {
+            _fire(utc);
+        }
+    }
+    bool night() const { return _night; }
+    bool alarm() const { return _alarm; }
+    int32_t offset() const { return _offset; }
+    uint32_t next(ScheduleEvent event) const { return _next[event]; }
+
+private:
+    void _fire(uint32_t utc);
+    void _planZone(uint32_t utc);
+    void _planWindows(uint32_t utc);
+    uint32_t _nextChange(uint32_t local, uint32_t start, uint32_t end, bool &inside);
+    ZoneOffset _zoneOffset = nullptr;
+    std::function<void()> _handlers[EVENT_COUNT];
+    uint32_t _next[EVENT_COUNT] = {SCHEDULE_NEVER, SCHEDULE_NEVER, SCHEDULE_NEVER};
+    uint32_t _due = SCHEDULE_NEVER;
+    int32_t _offset = 0;
+    bool _night = false;
+    bool _alarm = false;
+    uint32_t _nightStart = 0; // seconds of the local day
+    uint32_t _nightEnd = 0;
+    bool _alarmActive = false;
+    uint32_t _alarmStart = 0;
+};
+
+#endif //scheduler_h
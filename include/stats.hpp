@@ -0,0 +1,88 @@
+#ifndef stats_h
+#define stats_h
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+enum LoopStage
+{
+    STAGE_WEBSERVER,
+    STAGE_CONFIG,
+    STAGE_ROLLOVER,
+    STAGE_RENDER,
+    STAGE_SHOW,
+    STAGE_MQTT,
+    STAGE_MDNS,
+    STAGE_EVENTS,
+    STAGE_REALTIME,
+    STAGE_COUNT
+};
+
+struct FrameStats
+{
+    uint32_t interval = 16666;  // µs between frames
+    uint32_t deadline = 0;      // micros() the next frame is due
+    uint32_t frameStart = 0;    // micros() the current frame started
+    uint32_t elapsed = 0;       // µs since the previous frame started
+    uint32_t jitter = 0;        // µs the current frame started late
+    uint32_t maxJitter = 0;
+    uint32_t rendered = 0;
+    uint32_t late = 0;
+    uint32_t dropped = 0;
+};
+
+// Counters of the realtime pixel stream
+struct RealtimeStats
+{
+    uint32_t received = 0; // frames completed by the sender
+    uint32_t late = 0;     // packets older than the ones before, discarded
+    uint32_t dropped = 0;  // frames overwritten in the jitter buffer before being shown
+    uint32_t shown = 0;
+    uint32_t underruns = 0; // ticks without a buffered frame while streaming
+    uint32_t invalid = 0;   // packets that are neither DDP nor E1.31 data
+};
+
+// State of the NTP client
+struct NtpStats
+{
+    uint32_t requests = 0;
+    uint32_t replies = 0;  // valid replies, each one corrects the time
+    uint32_t timeouts = 0; // requests without a reply in time
+    uint32_t invalid = 0;  // replies that were not for the last request or unsynchronized
+    uint32_t steps = 0;    // corrections too large to be slewed
+    int32_t offset = 0;    // µs the server was ahead at the last reply
+    uint32_t rtt = 0;      // µs round trip time of the last reply, without the time spent on the server
+    int32_t drift = 0;     // ppb the clock runs fast against the server
+    uint32_t lastSync = 0; // millis() of the last reply
+};
+
+#define HISTOGRAM_BUCKETS 12
+
+// Durations in µs sorted into fixed buckets, the last bucket takes
+// everything above the largest bound.
+struct Histogram
+{
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+};
+
+class Stats
+{
+public:
+    Stats();
+    uint32_t record(LoopStage stage, uint32_t start);
+    void reset();
+    void toJSON(JsonDocument &doc);
+    void toPrometheus(Print &out);
+    static void writeMetric(Print &out, const __FlashStringHelper *name, const __FlashStringHelper *type, uint32_t value);
+    static void writeSeconds(Print &out, uint64_t us);
+    Histogram stages[STAGE_COUNT] = {};
+    const FrameStats *frames = nullptr;
+    const RealtimeStats *realtime = nullptr;
+    const NtpStats *ntp = nullptr;
+    static const uint32_t bucketBounds[HISTOGRAM_BUCKETS - 1];
+    static const char *stageNames[STAGE_COUNT];
+};
+
+#endif //stats_h
@@ -0,0 +1,80 @@
+#ifndef tcpclient_h
+#define tcpclient_h
+#include <Arduino.h>
+#include <Client.h>
+#if defined(ESP8266)
+#include <ESP8266WiFi.h>
+#include <lwip/tcp.h>
+#elif defined(ESP32)
+#include <WiFi.h>
+#else
+#include <IPAddress.h>
+#endif
+
+// States of TcpClient
+#define TCP_CLOSED 0
+#define TCP_CONNECTING 1
+#define TCP_OPEN 2
+#define TCP_FAILED 3 // refused, reset or closed by the peer
+
+#define TCP_RX_BUFFER 256
+#define TCP_TX_BUFFER 512 // bytes write() holds back while the stack is full
+
+// TCP connection whose calls all return right away, used as the Client
+// of PubSubClient. open() starts the connect, status() tells when it got
+// through. write() hands a packet to the stack, and what the stack cannot
+// take right now to a small buffer that flush() drains on later passes.
+// A packet that fits in neither is refused as a whole, so the peer never
+// gets half of it. read() only returns what already arrived.
+// ESP8266 has no sockets, it uses the raw API of lwIP. ESP32 and the
+// native build use non-blocking sockets.
+class TcpClient : public Client
+{
+public:
+    ~TcpClient() { close(); }
+    bool open(IPAddress ip, uint16_t port);
+    uint8_t status();
+    void close();
+    size_t queued() const { return _txLength; }
+
+    // open() connects, the blocking connect of Client is not supported
+    int connect(IPAddress, uint16_t) { return 0; }
+    int connect(const char *, uint16_t) { return 0; }
+#if defined(ESP32)
+    // newer ESP32 cores declare these in Client as well
+    int connect(IPAddress, uint16_t, int32_t) { return 0; }
+    int connect(const char *, uint16_t, int32_t) { return 0; }
+#endif
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    int available();
+    int read();
+    int read(uint8_t *buffer, size_t size);
+    int peek();
+    void flush();
+    void stop() { close(); }
+    uint8_t connected();
+    operator bool() { return connected(); }
+
+private:
+    size_t _room();
+    size_t _send(const uint8_t *data, size_t size);
+    uint8_t _status = TCP_CLOSED;
+    uint8_t _tx[TCP_TX_BUFFER];
+    size_t _txLength = 0;
+#if defined(ESP8266)
+    static err_t _connected(void *arg, tcp_pcb *pcb, err_t err);
+    static err_t _received(void *arg, tcp_pcb *pcb, pbuf *p, err_t err);
+    static void _error(void *arg, err_t err);
+    tcp_pcb *_pcb = nullptr;
+    pbuf *_rx = nullptr;  // received data not read yet
+    size_t _rxOffset = 0; // bytes of the first pbuf already read
+#else
+    int _socket = -1;
+    uint8_t _rx[TCP_RX_BUFFER];
+    size_t _rxStart = 0;
+    size_t _rxEnd = 0;
+#endif
+};
+
+#endif //tcpclient_h
@@ -1,59 +1,45 @@
 #ifndef timefunc_h
 #define timefunc_h
 #include <ezTime.h>
-uint64_t lasttime = 0;
+#include "stats.hpp"
 
-bool tick()
-{
-    unsigned long diff = micros() - lasttime;
+// Frames are due on a fixed grid of absolute deadlines, so a slow pass of
+// loop() delays one frame instead of shifting all following ones. Frames
+// that start more than a quarter interval after their deadline count as
+// late, deadlines that passed without a frame count as dropped.
+FrameStats frameStats;
 
-    if (diff >= 16666 || diff < 0)
-    {
-        lasttime = micros();
-        frame++;
-        return true;
-    }
-    return false;
+void setFrameRate(uint32_t fps)
+{
+    frameStats.interval = 1000000 / fps;
+    frameStats.deadline = micros();
 }
 
-bool isNight(uint8_t h, uint8_t m)
+bool tick()
 {
-    uint16_t currentMinutes = h * 60 + m;
-    if (config.config.nightTimeBegins > config.config.nightTimeEnds)
-    {
-        if (config.config.nightTimeBegins <= currentMinutes || currentMinutes <= config.config.nightTimeEnds)
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
-    }
-    else
+    uint32_t now = micros();
+    int32_t lateness = (int32_t)(now - frameStats.deadline);
+    if (lateness < 0)
     {
-        if (config.config.nightTimeBegins <= currentMinutes && currentMinutes <= config.config.nightTimeEnds)
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
+        return false;
     }
-}
 
-bool isAlarm()
-{
-    uint16_t currentMinutes = currentHour * 60 + currentMinute;
-    if (currentMinutes == config.config.alarmTime && config.config.alarmActive)
+    uint32_t missed = lateness / frameStats.interval;
+    frameStats.dropped += missed;
+    frameStats.deadline += (missed + 1) * frameStats.interval;
+
+    frameStats.jitter = lateness - missed * frameStats.interval;
+    frameStats.maxJitter = max(frameStats.maxJitter, frameStats.jitter);
+    if (missed > 0 || frameStats.jitter > frameStats.interval / 4)
     {
-        return true;
+        frameStats.late++;
     }
-    else
-    {
-        return false;
-    };
+
+    frameStats.elapsed = now - frameStats.frameStart;
+    frameStats.frameStart = now;
+    frameStats.rendered++;
+    frame++;
+    return true;
 }
 
 #endif //timefunc_h
\ No newline at end of file
@@ -3,23 +3,39 @@
 
 Config config;
 Timezone localTime;
+WallClock wallClock;
+#ifndef NATIVE_BUILD
 Webserver webserver;
 WiFiClient espClient;
 Mqtt mqtt;
+Stats stats;
+ClockMode currentMode = MODE_TIME;
+Realtime realtime;
+Scheduler scheduler;
+NtpClient ntp(wallClock);
+Resolver ntpResolver;
+bool ntpResolving = false; // ntpResolver looks up the time server
+#endif
 
 uint8_t currentMinute = 60,
         currentSecond = 60,
-        currentHour = 24,
-        currentDayPos = 32,
-        currentWeekdayPos = 8,
-        currentMonthPos = 13;
+        currentHour = 24;
+
+uint16_t currentDayPos = 32,
+         currentWeekdayPos = 8,
+         currentMonthPos = 13;
 
 bool night = true,
      alarm = false,
-     topHour = false,
-     animationRendered = false;
+     topHour = false;
+
+uint32_t frame = 0,
+         secondStart = 0;
 
-uint32_t frame = 0;
+uint32_t stripHash = 0,
+         bgStripHash = 0,
+         skippedFrames = 0,
+         skippedBgFrames = 0;
 
 RgbColor off(0, 0, 0),
     hourColor(0, 0, 0),
@@ -50,6 +66,9 @@ NeoPixelBus<NeoGrbFeature, NeoEsp8266BitBangWs2812xMethod> *bgStrip = NULL;
 #elif defined(ESP32)
 NeoPixelBus<NeoGrbFeature, NeoEsp32BitBangWs2812xMethod> *strip = NULL;
 NeoPixelBus<NeoGrbFeature, NeoEsp32BitBangWs2812xMethod> *bgStrip = NULL;
+#elif defined(NATIVE_BUILD)
+NeoPixelBus<NeoGrbFeature, NeoNativeMethod> *strip = NULL;
+NeoPixelBus<NeoGrbFeature, NeoNativeMethod> *bgStrip = NULL;
 #endif
 
 #endif //vars_h
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef wallclock_h
+#define wallclock_h
+#include <Arduino.h>
+
+// Boundaries reported by WallClock::update(), a boundary implies the
+// smaller ones
+#define CLOCK_SECOND (1 << 0)
+#define CLOCK_MINUTE (1 << 1)
+#define CLOCK_HOUR (1 << 2)
+#define CLOCK_DAY (1 << 3)
+
+#define WALLCLOCK_SLEW_RATE 500 // µs the time is corrected by per second at most
+
+// Local time counted in micros() from the last time sync. sync() pairs a
+// UTC time with the micros() it was valid at, from then on update()
+// advances the time by itself and reports the boundaries crossed since
+// the last call. The second starts when it actually began and not when
+// loop() happened to notice, so the phase within the second is exact to
+// the sync. update() has to be called at least once per micros() wrap,
+// about every 71 minutes. Small corrections are slewed in with every
+// second instead of stepping the time, so it never runs backwards.
+class WallClock
+{
+public:
+    void sync(uint64_t time, uint32_t now);
+    void slew(int32_t offset);
+    void setOffset(int32_t offset);
+    uint8_t update(uint32_t now);
+    bool synced() const { return _synced; }
+    uint32_t utc() const { return _utc; }
+    uint64_t time(uint32_t now) const;
+    uint16_t ms(uint32_t now) const;
+    int32_t pendingSlew() const { return _slew; }
+    uint32_t secondStart() const { return _secondStart; }
+    uint8_t second() const { return _second; }
+    uint8_t minute() const { return _minute; }
+    uint8_t hour() const { return _hour; }
+    uint8_t day() const { return _day; }
+    uint8_t month() const { return _month; }
+    uint8_t weekday() const { return _weekday; }
+
+private:
+    void _split(uint32_t local);
+    bool _synced = false;
+    uint32_t _utc = 0;         // seconds since 1970 of the current second
+    uint32_t _secondStart = 0; // micros() the current second began
+    int32_t _offset = 0;       // seconds local time is ahead of UTC
+    int32_t _slew = 0;         // µs the time still has to be corrected by
+    uint32_t _shown = 0;       // local time of the last update()
+    bool _started = false;     // update() reported a time since the sync
+    uint8_t _second = 0;
+    uint8_t _minute = 0;
+    uint8_t _hour = 0;
+    uint8_t _day = 1;
+    uint8_t _month = 1;
+    uint8_t _weekday = 4; // 1 is monday, 1970-01-01 was a thursday
+};
+
+#endif //wallclock_h
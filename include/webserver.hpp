@@ -15,23 +15,48 @@
 #endif
 #include <ezTime.h>
 #include "config.hpp"
+#include "stats.hpp"
+#include "mqtt.hpp"
+#include "chunkedprint.hpp"
+#include "preview.hpp"
+#include <WebSocketsServer.h>
+
+#define MAX_ROUTES 16
+
+struct Route
+{
+    const char *uri;
+    HTTPMethod method;
+    uint32_t requests;
+};
 
 class Webserver
 {
 public:
     Webserver();
-    void setup(Config &config);
+    void setup(Config &config, Stats &stats, Mqtt &mqtt);
     void handleRequest();
+    void publishFrame(const uint8_t *pixels, uint16_t count, const uint8_t *bgPixels, uint16_t bgCount);
     bool triggerWifiConf = false;
 
 private:
+    void _on(const char *uri, HTTPMethod method, std::function<void()> handler);
+    void _handleMetrics(Config &config, Stats &stats, Mqtt &mqtt);
+    Route _routes[MAX_ROUTES] = {};
+    uint8_t _routeCount = 0;
+    uint32_t _notFoundRequests = 0;
+    uint32_t _bootId = 0;
     void _handleNotFound();
     void _handleDataGet(Config &config);
     void _handleDataPut(Config &config);
+    void _handleDataPatch(Config &config);
     void _resetConfig(Config &config);
     void _handleIndex(char *lang);
     void _handleTime();
+    void _handleStats(Stats &stats);
     void _handleWifiConf();
+    void _handlePreviewEvent(uint8_t client, WStype_t type);
+    Preview _preview;
 };
 
 #endif //webserver_h
\ No newline at end of file
@@ -1,14 +1,20 @@
 #include "config.hpp"
 #include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <cstring>
 
-#if defined(ESP8266)
+#if defined(ESP8266) || defined(NATIVE_BUILD)
 #define MAXPINS 16
-#elif definded(ESP32)
+#define CONFIG_FS LittleFS
+#elif defined(ESP32)
 #define MAXPINS 35
+#define CONFIG_FS SPIFFS
 #endif
 #define MAXLEDS 360
+#define CONFIG_JSON_FILE "/data.json"
+#define CONFIG_BIN_FILE "/config.bin"
+#define CONFIG_TMP_FILE "/config.tmp"
 Config::Config()
 {
 }
@@ -116,267 +122,742 @@ static void _colorSettingToJson(JsonDocument &doc, const char *name, const Color
 
 void Config::configToJSON(JsonDocument &doc, bool skipSensitiveData)
 {
-        Config::locked = true;
+        const ConfigData &data = *Config::_published;
         if (!skipSensitiveData)
         {
-                doc["hostname"] = config.hostname;
-                doc["timeserver"] = config.timeserver;
-                doc["timezone"] = config.timezone;
+                doc["hostname"] = data.hostname;
+                doc["timeserver"] = data.timeserver;
+                doc["timezone"] = data.timezone;
         }
 
-        _colorSettingToJson(doc, "hourColor", config.hourColor);
-        _colorSettingToJson(doc, "minuteColor", config.minuteColor);
-        _colorSettingToJson(doc, "secondColor", config.secondColor);
+        _colorSettingToJson(doc, "hourColor", data.hourColor);
+        _colorSettingToJson(doc, "minuteColor", data.minuteColor);
+        _colorSettingToJson(doc, "secondColor", data.secondColor);
+
+        _colorSettingToJson(doc, "hourColorDimmed", data.hourColorDimmed);
+        _colorSettingToJson(doc, "minuteColorDimmed", data.minuteColorDimmed);
+        _colorSettingToJson(doc, "secondColorDimmed", data.secondColorDimmed);
+
+        doc["hourDot"] = data.hourDot;
+        doc["hourSegment"] = data.hourSegment;
+        doc["hourQuarter"] = data.hourQuarter;
+
+        _colorSettingToJson(doc, "hourDotColor", data.hourDotColor);
+        _colorSettingToJson(doc, "hourSegmentColor", data.hourSegmentColor);
+        _colorSettingToJson(doc, "hourQuarterColor", data.hourQuarterColor);
+
+        _colorSettingToJson(doc, "hourDotColorDimmed", data.hourDotColorDimmed);
+        _colorSettingToJson(doc, "hourSegmentColorDimmed", data.hourSegmentColorDimmed);
+        _colorSettingToJson(doc, "hourQuarterColorDimmed", data.hourQuarterColorDimmed);
+
+        doc["dayMonth"] = data.dayMonth;
+        _colorSettingToJson(doc, "dayColor", data.dayColor);
+        _colorSettingToJson(doc, "monthColor", data.monthColor);
+        _colorSettingToJson(doc, "weekdayColor", data.weekdayColor);
+        _colorSettingToJson(doc, "dayColorDimmed", data.dayColorDimmed);
+        _colorSettingToJson(doc, "monthColorDimmed", data.monthColorDimmed);
+        _colorSettingToJson(doc, "weekdayColorDimmed", data.weekdayColorDimmed);
+        doc["monthOffset"] = data.monthOffset + 1;
+        doc["dayOffset"] = data.dayOffset + 1;
+        doc["weekdayOffset"] = data.weekdayOffset + 1;
+
+        doc["nightTimeBegins"] = data.nightTimeBegins;
+        doc["nightTimeEnds"] = data.nightTimeEnds;
+
+        doc["hourHandStyle"] = data.hourHandStyle;
+        doc["hourLight"] = data.hourLight;
+        doc["blendColors"] = data.blendColors;
+        doc["fluidMotion"] = data.fluidMotion;
+        doc["frameRate"] = data.frameRate;
+
+        doc["alarmTime"] = data.alarmTime;
+        doc["alarmActive"] = data.alarmActive;
+
+        doc["ledPin"] = data.ledPin;
+        doc["ledCount"] = data.ledCount;
+        doc["ledRoot"] = data.ledRoot + 1;
+        doc["clockLedCount"] = data.clockLedCount;
+
+        doc["bgLight"] = data.bgLight;
+        doc["bgLedPin"] = data.bgLedPin;
+        doc["bgLedCount"] = data.bgLedCount;
+        _colorSettingToJson(doc, "bgColor", data.bgColor);
+        _colorSettingToJson(doc, "bgColorDimmed", data.bgColorDimmed);
+
+        doc["language"] = data.language;
 
-        _colorSettingToJson(doc, "hourColorDimmed", config.hourColorDimmed);
-        _colorSettingToJson(doc, "minuteColorDimmed", config.minuteColorDimmed);
-        _colorSettingToJson(doc, "secondColorDimmed", config.secondColorDimmed);
+        if (!skipSensitiveData)
+        {
+                doc["mqttActive"] = data.mqttActive;
+                doc["mqttServer"] = data.mqttServer;
+                doc["mqttUser"] = data.mqttUser;
+                doc["mqttPassword"] = data.mqttPassword;
+                doc["mqttPort"] = data.mqttPort;
+                doc["mqttBaseTopic"] = data.mqttBaseTopic;
+        }
 
-        doc["hourDot"] = config.hourDot;
-        doc["hourSegment"] = config.hourSegment;
-        doc["hourQuarter"] = config.hourQuarter;
+#if defined(UART_MODE) || defined(DMA_MODE)
+        doc["pinsLocked"] = true;
+#else
+        doc["pinsLocked"] = false;
+#endif
+}
 
-        _colorSettingToJson(doc, "hourDotColor", config.hourDotColor);
-        _colorSettingToJson(doc, "hourSegmentColor", config.hourSegmentColor);
-        _colorSettingToJson(doc, "hourQuarterColor", config.hourQuarterColor);
+// Reads fields from a JSON document into ConfigData with the validation
+// rules of each field. A missing key resets the field to its default, or
+// keeps its current value when patching. When patching, every field that
+// actually changed is written to the changes document.
+class ConfigReader
+{
+public:
+        ConfigReader(const JsonDocument &doc, JsonDocument *changes) : _doc(doc), _changes(changes)
+        {
+        }
 
-        _colorSettingToJson(doc, "hourDotColorDimmed", config.hourDotColorDimmed);
-        _colorSettingToJson(doc, "hourSegmentColorDimmed", config.hourSegmentColorDimmed);
-        _colorSettingToJson(doc, "hourQuarterColorDimmed", config.hourQuarterColorDimmed);
+        bool patch() const
+        {
+                return _changes != nullptr;
+        }
 
-        doc["dayMonth"] = config.dayMonth;
-        _colorSettingToJson(doc, "dayColor", config.dayColor);
-        _colorSettingToJson(doc, "monthColor", config.monthColor);
-        _colorSettingToJson(doc, "weekdayColor", config.weekdayColor);
-        _colorSettingToJson(doc, "dayColorDimmed", config.dayColorDimmed);
-        _colorSettingToJson(doc, "monthColorDimmed", config.monthColorDimmed);
-        _colorSettingToJson(doc, "weekdayColorDimmed", config.weekdayColorDimmed);
-        doc["monthOffset"] = config.monthOffset + 1;
-        doc["dayOffset"] = config.dayOffset + 1;
-        doc["weekdayOffset"] = config.weekdayOffset + 1;
+        void readBool(const char *key, bool &field, bool defaultValue)
+        {
+                JsonVariantConst value = _doc[key];
+                if (value.isNull() && patch())
+                {
+                        return;
+                }
+                bool previous = field;
+                field = value | (patch() ? previous : defaultValue);
+                if (patch() && field != previous)
+                {
+                        (*_changes)[key] = field;
+                }
+        }
 
-        doc["nightTimeBegins"] = config.nightTimeBegins;
-        doc["nightTimeEnds"] = config.nightTimeEnds;
+        // offset is subtracted from the JSON value before storing it
+        template <typename T>
+        void readInt(const char *key, T &field, uint32_t defaultValue, uint32_t min, uint32_t max, uint32_t offset = 0)
+        {
+                JsonVariantConst value = _doc[key];
+                if (value.isNull() && patch())
+                {
+                        return;
+                }
+                T previous = field;
+                uint32_t current = value | (patch() ? static_cast<uint32_t>(previous + offset) : defaultValue);
+                field = static_cast<T>(_clampInt(current, min, max) - offset);
+                if (patch() && field != previous)
+                {
+                        (*_changes)[key] = static_cast<uint32_t>(field + offset);
+                }
+        }
 
-        doc["hourHandStyle"] = config.hourHandStyle;
-        doc["hourLight"] = config.hourLight;
-        doc["blendColors"] = config.blendColors;
-        doc["fluidMotion"] = config.fluidMotion;
+        void readColor(const char *key, ColorSetting &field, uint16_t defaultHue, uint8_t defaultBrightness)
+        {
+                JsonVariantConst value = _doc[key];
+                if (value.isNull() && patch())
+                {
+                        return;
+                }
+                ColorSetting previous = field;
+                if (patch())
+                {
+                        field = _parseColorSetting(value, previous.hue, previous.brightness);
+                }
+                else
+                {
+                        field = _parseColorSetting(value, defaultHue, defaultBrightness);
+                }
+                if (patch() && (field.hue != previous.hue || field.brightness != previous.brightness))
+                {
+                        _colorSettingToJson(*_changes, key, field);
+                }
+        }
 
-        doc["alarmTime"] = config.alarmTime;
-        doc["alarmActive"] = config.alarmActive;
+        void readString(const char *key, char *field, size_t size, const char *defaultValue)
+        {
+                const char *value = _doc[key].as<const char *>();
+                if (value == nullptr)
+                {
+                        if (patch())
+                        {
+                                return;
+                        }
+                        value = defaultValue;
+                }
+                if (patch() && strncmp(field, value, size - 1) == 0)
+                {
+                        return;
+                }
+                strlcpy(field, value, size);
+                if (patch())
+                {
+                        (*_changes)[key] = field;
+                }
+        }
 
-        doc["ledPin"] = config.ledPin;
-        doc["ledCount"] = config.ledCount;
-        doc["ledRoot"] = config.ledRoot + 1;
+private:
+        const JsonDocument &_doc;
+        JsonDocument *_changes;
+};
 
-        doc["bgLight"] = config.bgLight;
-        doc["bgLedPin"] = config.bgLedPin;
-        doc["bgLedCount"] = config.bgLedCount;
-        _colorSettingToJson(doc, "bgColor", config.bgColor);
-        _colorSettingToJson(doc, "bgColorDimmed", config.bgColorDimmed);
+// The buffer that is not published, the next config is prepared in it
+ConfigData *Config::_inactive()
+{
+        return Config::_published == &Config::_buffers[0] ? &Config::_buffers[1] : &Config::_buffers[0];
+}
+
+// Returns the inactive buffer holding a copy of the published config
+ConfigData &Config::_edit()
+{
+        ConfigData *data = Config::_inactive();
+        *data = *Config::_published;
+        return *data;
+}
 
-        doc["language"] = config.language;
+static bool _colorChanged(const ColorSetting &a, const ColorSetting &b)
+{
+        return a.hue != b.hue || a.brightness != b.brightness;
+}
 
-        if (!skipSensitiveData)
+// Returns the CONFIG_DIRTY_* groups that differ between a and b
+static uint16_t _changedGroups(const ConfigData &a, const ConfigData &b)
+{
+        uint16_t groups = 0;
+        if (_colorChanged(a.hourColor, b.hourColor) ||
+            _colorChanged(a.minuteColor, b.minuteColor) ||
+            _colorChanged(a.secondColor, b.secondColor) ||
+            _colorChanged(a.hourColorDimmed, b.hourColorDimmed) ||
+            _colorChanged(a.minuteColorDimmed, b.minuteColorDimmed) ||
+            _colorChanged(a.secondColorDimmed, b.secondColorDimmed) ||
+            a.hourDot != b.hourDot ||
+            a.hourSegment != b.hourSegment ||
+            a.hourQuarter != b.hourQuarter ||
+            _colorChanged(a.hourDotColor, b.hourDotColor) ||
+            _colorChanged(a.hourSegmentColor, b.hourSegmentColor) ||
+            _colorChanged(a.hourQuarterColor, b.hourQuarterColor) ||
+            _colorChanged(a.hourDotColorDimmed, b.hourDotColorDimmed) ||
+            _colorChanged(a.hourSegmentColorDimmed, b.hourSegmentColorDimmed) ||
+            _colorChanged(a.hourQuarterColorDimmed, b.hourQuarterColorDimmed) ||
+            a.dayMonth != b.dayMonth ||
+            _colorChanged(a.monthColor, b.monthColor) ||
+            _colorChanged(a.dayColor, b.dayColor) ||
+            _colorChanged(a.weekdayColor, b.weekdayColor) ||
+            _colorChanged(a.monthColorDimmed, b.monthColorDimmed) ||
+            _colorChanged(a.dayColorDimmed, b.dayColorDimmed) ||
+            _colorChanged(a.weekdayColorDimmed, b.weekdayColorDimmed) ||
+            strcmp(a.hourHandStyle, b.hourHandStyle) != 0 ||
+            a.hourLight != b.hourLight ||
+            a.blendColors != b.blendColors ||
+            a.fluidMotion != b.fluidMotion ||
+            a.bgLight != b.bgLight ||
+            _colorChanged(a.bgColor, b.bgColor) ||
+            _colorChanged(a.bgColorDimmed, b.bgColorDimmed))
+        {
+                groups |= CONFIG_DIRTY_COLORS;
+        }
+        if (a.ledCount != b.ledCount ||
+            a.ledRoot != b.ledRoot ||
+            a.clockLedCount != b.clockLedCount ||
+            a.dayOffset != b.dayOffset ||
+            a.monthOffset != b.monthOffset ||
+            a.weekdayOffset != b.weekdayOffset)
         {
-                doc["mqttActive"] = config.mqttActive;
-                doc["mqttServer"] = config.mqttServer;
-                doc["mqttUser"] = config.mqttUser;
-                doc["mqttPassword"] = config.mqttPassword;
-                doc["mqttPort"] = config.mqttPort;
-                doc["mqttBaseTopic"] = config.mqttBaseTopic;
+                groups |= CONFIG_DIRTY_GEOMETRY;
         }
+        if (a.nightTimeBegins != b.nightTimeBegins || a.nightTimeEnds != b.nightTimeEnds)
+        {
+                groups |= CONFIG_DIRTY_NIGHT;
+        }
+        if (a.alarmActive != b.alarmActive || a.alarmTime != b.alarmTime)
+        {
+                groups |= CONFIG_DIRTY_ALARM;
+        }
+        if (a.ledPin != b.ledPin ||
+            a.ledCount != b.ledCount ||
+            a.bgLedPin != b.bgLedPin ||
+            a.bgLedCount != b.bgLedCount)
+        {
+                groups |= CONFIG_DIRTY_STRIP;
+        }
+        if (a.mqttActive != b.mqttActive ||
+            a.mqttTLS != b.mqttTLS ||
+            a.mqttPort != b.mqttPort ||
+            strcmp(a.mqttServer, b.mqttServer) != 0 ||
+            strcmp(a.mqttUser, b.mqttUser) != 0 ||
+            strcmp(a.mqttPassword, b.mqttPassword) != 0 ||
+            strcmp(a.mqttBaseTopic, b.mqttBaseTopic) != 0 ||
+            strcmp(a.mqttFingerprint, b.mqttFingerprint) != 0)
+        {
+                groups |= CONFIG_DIRTY_MQTT;
+        }
+        if (a.frameRate != b.frameRate)
+        {
+                groups |= CONFIG_DIRTY_TIMING;
+        }
+        if (strcmp(a.hostname, b.hostname) != 0 ||
+            strcmp(a.timeserver, b.timeserver) != 0 ||
+            strcmp(a.timezone, b.timezone) != 0 ||
+            strcmp(a.language, b.language) != 0)
+        {
+                groups |= CONFIG_DIRTY_SYSTEM;
+        }
+        return groups;
+}
 
-#if defined(UART_MODE) || defined(DMA_MODE)
-        doc["pinsLocked"] = true;
-#else
-        doc["pinsLocked"] = false;
-#endif
-        Config::locked = false;
+// Makes data the published config
+void Config::_publish(ConfigData &data)
+{
+        Config::dirty |= _changedGroups(*Config::_published, data);
+        Config::_published = &data;
+        Config::generation++;
+}
+
+// Copies the published config into config, where the renderer and the
+// rest of the loop read it from, if a new one was published since
+bool Config::snapshot()
+{
+        if (Config::generation == Config::_snapshotGeneration)
+        {
+                return false;
+        }
+        config = *Config::_published;
+        Config::_snapshotGeneration = Config::generation;
+        return true;
+}
+
+// Publishes a complete config, like loading one does
+void Config::set(const ConfigData &data)
+{
+        ConfigData *inactive = Config::_inactive();
+        *inactive = data;
+        Config::_publish(*inactive);
 }
 
 bool Config::JSONToConfig(JsonDocument &doc, bool skipSensitiveData)
 {
+        return Config::_readJSON(doc, nullptr, skipSensitiveData);
+}
 
-        Config::locked = true;
-        if (doc.containsKey("hostname"))
+// Applies only the keys present in doc and returns the fields that
+// changed in changes
+bool Config::JSONPatchToConfig(JsonDocument &doc, JsonDocument &changes, bool skipSensitiveData)
+{
+        return Config::_readJSON(doc, &changes, skipSensitiveData);
+}
+
+// The bodies of the /data.json requests, the web server wraps them in
+// its responses and the heap test measures them the same way. GET still
+// fills a document before writing it, which holds up to 2 KB of heap
+// while the answer is sent.
+void Config::writeJSON(Print &out)
+{
+        DynamicJsonDocument doc(CONFIG_JSON_CAPACITY);
+        configToJSON(doc);
+        serializeJson(doc, out);
+}
+
+// Replaces the config and answers with it. The document is cleared in
+// between, so none of the keys like saveData or reset that were in the
+// request end up in the answer.
+void Config::putJSON(const char *body, size_t length, Print &out)
+{
+        DynamicJsonDocument doc(CONFIG_JSON_CAPACITY);
+        deserializeJson(doc, body, length);
+        if (JSONToConfig(doc))
         {
-                strlcpy(config.hostname,
-                        doc["hostname"],
-                        sizeof(config.hostname));
+                requestSave();
         }
-        else
+        doc.clear();
+        configToJSON(doc);
+        serializeJson(doc, out);
+}
+
+// Applies the fields of body and leaves the ones that changed in changes,
+// false if body is not JSON. The request is gone again before the caller
+// writes the answer.
+bool Config::patchJSON(const char *body, size_t length, JsonDocument &changes)
+{
+        DynamicJsonDocument doc(patchCapacity(length));
+        if (deserializeJson(doc, body, length))
         {
-#if defined(ESP8266)
-                uint32_t chipid = ESP.getChipId();
-#elif defined(ESP32)
-                uint64_t chipid = ESP.getEfuseMac();
-#endif
-                snprintf(config.hostname, sizeof(config.hostname), "ESPCLOCK-%06X", chipid);
+                return false;
         }
+        if (JSONPatchToConfig(doc, changes))
+        {
+                requestSave();
+        }
+        return true;
+}
 
-        strlcpy(config.timeserver,
-                doc["timeserver"] | "pool.ntp.org",
-                sizeof(config.timeserver));
-        strlcpy(config.timezone,
-                doc["timezone"] | "Europe/Berlin",
-                sizeof(config.timezone));
+// Room for a patch body of length bytes, and for the changes it causes
+size_t Config::patchCapacity(size_t length)
+{
+        return std::min<size_t>(CONFIG_JSON_CAPACITY, 256 + 2 * length);
+}
 
-        config.hourColor = _parseColorSetting(doc["hourColor"], 0, 100);
-        config.minuteColor = _parseColorSetting(doc["minuteColor"], 120, 100);
-        config.secondColor = _parseColorSetting(doc["secondColor"], 240, 100);
+bool Config::_readJSON(JsonDocument &doc, JsonDocument *changes, bool skipSensitiveData)
+{
+        ConfigData &data = Config::_edit();
+        ConfigReader reader(doc, changes);
 
-        config.hourColorDimmed = _parseColorSetting(doc["hourColorDimmed"], 0, 47);
-        config.minuteColorDimmed = _parseColorSetting(doc["minuteColorDimmed"], 120, 47);
-        config.secondColorDimmed = _parseColorSetting(doc["secondColorDimmed"], 240, 47);
+#if defined(ESP8266) || defined(NATIVE_BUILD)
+        uint32_t chipid = ESP.getChipId();
+#elif defined(ESP32)
+        uint64_t chipid = ESP.getEfuseMac();
+#endif
+        char defaultHostname[sizeof(data.hostname)];
+        snprintf(defaultHostname, sizeof(defaultHostname), "ESPCLOCK-%06X", chipid);
+        reader.readString("hostname", data.hostname, sizeof(data.hostname), defaultHostname);
+        reader.readString("timeserver", data.timeserver, sizeof(data.timeserver), "pool.ntp.org");
+        reader.readString("timezone", data.timezone, sizeof(data.timezone), "Europe/Berlin");
+
+        reader.readColor("hourColor", data.hourColor, 0, 100);
+        reader.readColor("minuteColor", data.minuteColor, 120, 100);
+        reader.readColor("secondColor", data.secondColor, 240, 100);
 
-        strlcpy(config.hourHandStyle,
-                doc["hourHandStyle"] | "simple",
-                sizeof(config.hourHandStyle));
-        config.hourDot = doc["hourDot"] | false;
-        config.hourSegment = doc["hourSegment"] | false;
-        config.hourQuarter = doc["hourQuarter"] | false;
+        reader.readColor("hourColorDimmed", data.hourColorDimmed, 0, 47);
+        reader.readColor("minuteColorDimmed", data.minuteColorDimmed, 120, 47);
+        reader.readColor("secondColorDimmed", data.secondColorDimmed, 240, 47);
 
-        config.hourDotColor = _parseColorSetting(doc["hourDotColor"], 0, 0);
-        config.hourSegmentColor = _parseColorSetting(doc["hourSegmentColor"], 0, 0);
-        config.hourQuarterColor = _parseColorSetting(doc["hourQuarterColor"], 240, 0);
+        reader.readString("hourHandStyle", data.hourHandStyle, sizeof(data.hourHandStyle), "simple");
+        reader.readBool("hourDot", data.hourDot, false);
+        reader.readBool("hourSegment", data.hourSegment, false);
+        reader.readBool("hourQuarter", data.hourQuarter, false);
 
-        config.hourDotColorDimmed = _parseColorSetting(doc["hourDotColorDimmed"], 0, 0);
-        config.hourSegmentColorDimmed = _parseColorSetting(doc["hourSegmentColorDimmed"], 0, 0);
-        config.hourQuarterColorDimmed = _parseColorSetting(doc["hourQuarterColorDimmed"], 0, 0);
+        reader.readColor("hourDotColor", data.hourDotColor, 0, 0);
+        reader.readColor("hourSegmentColor", data.hourSegmentColor, 0, 0);
+        reader.readColor("hourQuarterColor", data.hourQuarterColor, 240, 0);
 
-        config.dayMonth = doc["dayMonth"] | false;
-        config.dayColor = _parseColorSetting(doc["dayColor"], 312, 100);
-        config.monthColor = _parseColorSetting(doc["monthColor"], 59, 100);
-        config.weekdayColor = _parseColorSetting(doc["weekdayColor"], 167, 100);
+        reader.readColor("hourDotColorDimmed", data.hourDotColorDimmed, 0, 0);
+        reader.readColor("hourSegmentColorDimmed", data.hourSegmentColorDimmed, 0, 0);
+        reader.readColor("hourQuarterColorDimmed", data.hourQuarterColorDimmed, 0, 0);
 
-        config.dayColorDimmed = _parseColorSetting(doc["dayColorDimmed"], 312, 48);
-        config.monthColorDimmed = _parseColorSetting(doc["monthColorDimmed"], 59, 34);
-        config.weekdayColorDimmed = _parseColorSetting(doc["weekdayColorDimmed"], 167, 46);
+        reader.readBool("dayMonth", data.dayMonth, false);
+        reader.readColor("dayColor", data.dayColor, 312, 100);
+        reader.readColor("monthColor", data.monthColor, 59, 100);
+        reader.readColor("weekdayColor", data.weekdayColor, 167, 100);
 
-        config.nightTimeBegins = doc["nightTimeBegins"] | 1320;
-        config.nightTimeBegins = _clampInt(config.nightTimeBegins, 0, 1440);
+        reader.readColor("dayColorDimmed", data.dayColorDimmed, 312, 48);
+        reader.readColor("monthColorDimmed", data.monthColorDimmed, 59, 34);
+        reader.readColor("weekdayColorDimmed", data.weekdayColorDimmed, 167, 46);
 
-        config.nightTimeEnds = doc["nightTimeEnds"] | 480;
-        config.nightTimeEnds = _clampInt(config.nightTimeEnds, 0, 1440);
+        reader.readInt("nightTimeBegins", data.nightTimeBegins, 1320, 0, 1440);
+        reader.readInt("nightTimeEnds", data.nightTimeEnds, 480, 0, 1440);
 
-        config.hourLight = doc["hourLight"] | false;
-        config.blendColors = doc["blendColors"] | true;
-        config.fluidMotion = doc["fluidMotion"] | true;
+        reader.readBool("hourLight", data.hourLight, false);
+        reader.readBool("blendColors", data.blendColors, true);
+        reader.readBool("fluidMotion", data.fluidMotion, true);
+        reader.readInt("frameRate", data.frameRate, 60, 1, 120);
 
-        config.alarmActive = doc["alarmActive"] | false;
-        config.alarmTime = doc["alarmTime"] | 480;
+        reader.readBool("alarmActive", data.alarmActive, false);
+        reader.readInt("alarmTime", data.alarmTime, 480, 0, UINT32_MAX);
 
-        config.bgLight = doc["bgLight"] | false;
-        config.bgColor = _parseColorSetting(doc["bgColor"], 0, 0);
-        config.bgColorDimmed = _parseColorSetting(doc["bgColorDimmed"], 0, 0);
+        reader.readBool("bgLight", data.bgLight, false);
+        reader.readColor("bgColor", data.bgColor, 0, 0);
+        reader.readColor("bgColorDimmed", data.bgColorDimmed, 0, 0);
 
 #if defined(BITBANG_MODE) || defined(DEBUG_BUILD) || defined(ESP32)
-        config.bgLedPin = doc["bgLedPin"] | 15;
-        config.bgLedPin = _clampInt(config.bgLedPin, 0, MAXPINS);
+        reader.readInt("bgLedPin", data.bgLedPin, 15, 0, MAXPINS);
 #elif defined(UART_MODE)
         if (!skipSensitiveData)
-                config.bgLedPin = 1;
+                data.bgLedPin = 1;
 #elif defined(DMA_MODE)
         if (!skipSensitiveData)
-                config.bgLedPin = 2;
+                data.bgLedPin = 2;
 #endif
 
-        config.bgLedCount = doc["bgLedCount"] | 60;
-        config.bgLedCount = _clampInt(config.bgLedCount, 0, MAXLEDS);
+        reader.readInt("bgLedCount", data.bgLedCount, 60, 0, MAXLEDS);
 
 #if defined(BITBANG_MODE) || defined(DEBUG_BUILD) || defined(ESP32)
-        config.ledPin = doc["ledPin"] | 4;
-        config.ledPin = _clampInt(config.ledPin, 0, MAXPINS);
+        reader.readInt("ledPin", data.ledPin, 4, 0, MAXPINS);
 #elif defined(UART_MODE)
         if (!skipSensitiveData)
-                config.ledPin = 2;
+                data.ledPin = 2;
 #elif defined(DMA_MODE)
         if (!skipSensitiveData)
-                config.ledPin = 3;
+                data.ledPin = 3;
 #endif
 
-        config.ledCount = doc["ledCount"] | 60;
-        config.ledCount = _clampInt(config.ledCount, 0, MAXLEDS);
+        reader.readInt("ledCount", data.ledCount, 60, 0, MAXLEDS);
+        // the positions below are stored zero-based
+        reader.readInt("ledRoot", data.ledRoot, 1, 1, MAXLEDS, 1);
+        reader.readInt("clockLedCount", data.clockLedCount, 60, 12, MAXLEDS);
+        reader.readInt("dayOffset", data.dayOffset, 1, 1, MAXLEDS, 1);
+        reader.readInt("monthOffset", data.monthOffset, 1, 1, MAXLEDS, 1);
+        reader.readInt("weekdayOffset", data.weekdayOffset, 1, 1, MAXLEDS, 1);
+
+        reader.readString("language", data.language, sizeof(data.language), "en");
+
+        if (!skipSensitiveData)
+        {
+                reader.readBool("mqttActive", data.mqttActive, false);
+                reader.readString("mqttServer", data.mqttServer, sizeof(data.mqttServer), "mqtthost");
+                reader.readString("mqttUser", data.mqttUser, sizeof(data.mqttUser), "username");
+                reader.readString("mqttPassword", data.mqttPassword, sizeof(data.mqttPassword), "password");
+                reader.readInt("mqttPort", data.mqttPort, 1883, 1, 65535);
+        }
+        char defaultBaseTopic[144] = "espneopixelclock/";
+        snprintf(defaultBaseTopic, sizeof(defaultBaseTopic), "espneopixelclock/%s", data.hostname);
+        reader.readString("mqttBaseTopic", data.mqttBaseTopic, sizeof(data.mqttBaseTopic), defaultBaseTopic);
+
+        if (!reader.patch() || changes->size() > 0)
+        {
+                Config::_publish(data);
+        }
 
-        config.ledRoot = doc["ledRoot"] | 1;
-        config.ledRoot = _clampInt(config.ledRoot, 1, MAXLEDS);
+        if (!reader.patch() || doc.containsKey("reset"))
+        {
+                Config::_resetRequest = doc["reset"] == true;
+        }
 
-        config.dayOffset = doc["dayOffset"] | 1;
-        config.dayOffset = _clampInt(config.dayOffset, 1, MAXLEDS);
+        return doc["saveData"] == true;
+}
 
-        config.monthOffset = doc["monthOffset"] | 1;
-        config.monthOffset = _clampInt(config.monthOffset, 1, MAXLEDS);
+enum ConfigFieldType : uint8_t
+{
+        FIELD_BOOL,
+        FIELD_INT
+};
 
-        config.weekdayOffset = doc["weekdayOffset"] | 1;
-        config.weekdayOffset = _clampInt(config.weekdayOffset, 1, MAXLEDS);
+// A scalar inside ConfigData. Values are shown with base added, like the
+// one-based positions in the JSON config.
+struct ConfigField
+{
+        const char *name;
+        uint16_t offset;
+        uint8_t size;
+        ConfigFieldType type;
+        uint8_t base;
+        uint32_t min;
+        uint32_t max;
+};
+
+#define BOOL_FIELD(field) {#field, offsetof(ConfigData, field), sizeof(bool), FIELD_BOOL, 0, 0, 1}
+#define INT_FIELD(field, min, max, base) {#field, offsetof(ConfigData, field), sizeof(ConfigData::field), FIELD_INT, base, min, max}
+#define COLOR_FIELD(field)                                                                                                  \
+        {#field "/hue", offsetof(ConfigData, field) + offsetof(ColorSetting, hue), sizeof(uint16_t), FIELD_INT, 0, 0, 360}, \
+        {#field "/brightness", offsetof(ConfigData, field) + offsetof(ColorSetting, brightness), sizeof(uint8_t), FIELD_INT, 0, 0, 100}
+
+// Ranges as validated by _readJSON. Pins and the sensitive settings are
+// left out, they are only changed through the full config.
+static const ConfigField _fields[] = {
+        COLOR_FIELD(hourColor),
+        COLOR_FIELD(minuteColor),
+        COLOR_FIELD(secondColor),
+        COLOR_FIELD(hourColorDimmed),
+        COLOR_FIELD(minuteColorDimmed),
+        COLOR_FIELD(secondColorDimmed),
+        BOOL_FIELD(hourDot),
+        BOOL_FIELD(hourSegment),
+        BOOL_FIELD(hourQuarter),
+        COLOR_FIELD(hourDotColor),
+        COLOR_FIELD(hourSegmentColor),
+        COLOR_FIELD(hourQuarterColor),
+        COLOR_FIELD(hourDotColorDimmed),
+        COLOR_FIELD(hourSegmentColorDimmed),
+        COLOR_FIELD(hourQuarterColorDimmed),
+        BOOL_FIELD(dayMonth),
+        COLOR_FIELD(dayColor),
+        COLOR_FIELD(monthColor),
+        COLOR_FIELD(weekdayColor),
+        COLOR_FIELD(dayColorDimmed),
+        COLOR_FIELD(monthColorDimmed),
+        COLOR_FIELD(weekdayColorDimmed),
+        INT_FIELD(nightTimeBegins, 0, 1440, 0),
+        INT_FIELD(nightTimeEnds, 0, 1440, 0),
+        BOOL_FIELD(hourLight),
+        BOOL_FIELD(blendColors),
+        BOOL_FIELD(fluidMotion),
+        INT_FIELD(frameRate, 1, 120, 0),
+        BOOL_FIELD(alarmActive),
+        INT_FIELD(alarmTime, 0, UINT32_MAX, 0),
+        BOOL_FIELD(bgLight),
+        COLOR_FIELD(bgColor),
+        COLOR_FIELD(bgColorDimmed),
+        INT_FIELD(bgLedCount, 0, MAXLEDS, 0),
+        INT_FIELD(ledCount, 0, MAXLEDS, 0),
+        INT_FIELD(ledRoot, 1, MAXLEDS, 1),
+        INT_FIELD(clockLedCount, 12, MAXLEDS, 0),
+        INT_FIELD(dayOffset, 1, MAXLEDS, 1),
+        INT_FIELD(monthOffset, 1, MAXLEDS, 1),
+        INT_FIELD(weekdayOffset, 1, MAXLEDS, 1),
+};
+
+static_assert(sizeof(_fields) / sizeof(_fields[0]) == CONFIG_FIELD_COUNT, "CONFIG_FIELD_COUNT does not match _fields");
+
+static uint32_t _readField(const ConfigData &data, const ConfigField &field)
+{
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(&data) + field.offset;
+        switch (field.size)
+        {
+        case sizeof(uint8_t):
+                return *p;
+        case sizeof(uint16_t):
+                return *reinterpret_cast<const uint16_t *>(p);
+        default:
+                return *reinterpret_cast<const uint32_t *>(p);
+        }
+}
 
-        strlcpy(config.language,
-                doc["language"] | "en",
-                sizeof(config.language));
+static void _writeField(ConfigData &data, const ConfigField &field, uint32_t value)
+{
+        uint8_t *p = reinterpret_cast<uint8_t *>(&data) + field.offset;
+        switch (field.size)
+        {
+        case sizeof(uint8_t):
+                *p = static_cast<uint8_t>(value);
+                break;
+        case sizeof(uint16_t):
+                *reinterpret_cast<uint16_t *>(p) = static_cast<uint16_t>(value);
+                break;
+        default:
+                *reinterpret_cast<uint32_t *>(p) = value;
+        }
+}
 
-        if (!skipSensitiveData)
+// Parses "true", "false", "on", "off" or a decimal number in place
+static bool _parseScalar(const char *value, uint32_t &result)
+{
+        if (strcmp(value, "true") == 0 || strcmp(value, "on") == 0)
         {
-                config.mqttActive = doc["mqttActive"] | false;
-                strlcpy(config.mqttServer,
-                        doc["mqttServer"] | "mqtthost",
-                        sizeof(config.mqttServer));
-                strlcpy(config.mqttUser,
-                        doc["mqttUser"] | "mqttuser",
-                        sizeof(config.mqttUser));
-                strlcpy(config.mqttUser,
-                        doc["mqttUser"] | "username",
-                        sizeof(config.mqttUser));
-                strlcpy(config.mqttPassword,
-                        doc["mqttPassword"] | "password",
-                        sizeof(config.mqttPassword));
-                config.mqttPort = doc["mqttPort"] | 1883;
-                config.mqttPort = _clampInt(config.mqttPort, 1, 65535);
+                result = 1;
+                return true;
         }
-        char defaultBaseTopic[144] = "espneopixelclock/";
-        snprintf(defaultBaseTopic, sizeof(defaultBaseTopic), "espneopixelclock/%s", config.hostname);
+        if (strcmp(value, "false") == 0 || strcmp(value, "off") == 0)
+        {
+                result = 0;
+                return true;
+        }
+        if (*value < '0' || *value > '9')
+        {
+                return false;
+        }
+        char *end;
+        unsigned long parsed = strtoul(value, &end, 10);
+        if (*end != '\0' || parsed > UINT32_MAX)
+        {
+                return false;
+        }
+        result = static_cast<uint32_t>(parsed);
+        return true;
+}
 
-        strlcpy(config.mqttBaseTopic,
-                doc["mqttBaseTopic"] | defaultBaseTopic,
-                sizeof(config.mqttBaseTopic));
+const char *Config::fieldName(uint8_t index)
+{
+        return index < CONFIG_FIELD_COUNT ? _fields[index].name : nullptr;
+}
 
-        config.ledRoot--;
-        config.dayOffset--;
-        config.monthOffset--;
-        config.weekdayOffset--;
+// Current value of a field as it appears in the JSON config
+uint32_t Config::fieldValue(uint8_t index)
+{
+        const ConfigField &field = _fields[index];
+        return _readField(*Config::_published, field) + field.base;
+}
 
-        if (doc["reset"] == true)
+// Sets a single field from its text value with the same clamping as the
+// JSON config and publishes the config if it changed. Returns false for
+// unknown fields, unparsable values and unchanged fields.
+bool Config::setField(const char *name, const char *value)
+{
+        const ConfigField *field = nullptr;
+        for (const ConfigField &candidate : _fields)
         {
-                Config::_resetRequest = true;
+                if (strcmp(candidate.name, name) == 0)
+                {
+                        field = &candidate;
+                        break;
+                }
         }
-        else
+        uint32_t parsed;
+        if (field == nullptr || !_parseScalar(value, parsed))
         {
-                Config::_resetRequest = false;
-        };
+                return false;
+        }
+        if (field->type == FIELD_BOOL)
+        {
+                parsed = parsed != 0;
+        }
+        uint32_t stored = _clampInt(parsed, field->min, field->max) - field->base;
+        if (stored == _readField(*Config::_published, *field))
+        {
+                return false;
+        }
+        ConfigData &data = Config::_edit();
+        _writeField(data, *field, stored);
+        Config::_publish(data);
+        return true;
+}
 
-        Config::locked = false;
+// CRC-32 (IEEE 802.3) of the stored config, bitwise since it only runs
+// on load and save
+static uint32_t _crc32(const uint8_t *data, size_t length)
+{
+        uint32_t crc = 0xFFFFFFFF;
+        while (length--)
+        {
+                crc ^= *data++;
+                for (uint8_t i = 0; i < 8; i++)
+                {
+                        crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+                }
+        }
+        return ~crc;
+}
 
-        if (doc["saveData"] == true)
+// Reads config.bin straight into ConfigData. Fails on a missing file, a
+// different schema version or struct size and on a CRC mismatch. On ESP32
+// save() removes config.bin before renaming config.tmp, a power loss in
+// between leaves only the temporary file, which is complete by then.
+bool Config::loadBinary()
+{
+        if (Config::_loadBinary(CONFIG_BIN_FILE))
         {
                 return true;
         }
-        else
+        if (!Config::_loadBinary(CONFIG_TMP_FILE))
         {
                 return false;
-        };
+        }
+        if (!CONFIG_FS.exists(CONFIG_BIN_FILE))
+        {
+                CONFIG_FS.rename(CONFIG_TMP_FILE, CONFIG_BIN_FILE);
+        }
+        return true;
 }
 
-void Config::load()
+bool Config::_loadBinary(const char *path)
 {
-        // Open file for reading
-        Config::locked = true;
+        File sourcefile = CONFIG_FS.open(path, "r");
+        if (!sourcefile)
+        {
+                return false;
+        }
 
-#if defined(ESP8266)
-        File sourcefile = LittleFS.open("data.json", "r");
-#elif defined(ESP32)
-        File sourcefile = SPIFFS.open("/data.json", "r");
-#endif
+        ConfigHeader header;
+        ConfigData &data = *Config::_inactive();
+        bool valid = sourcefile.read(reinterpret_cast<uint8_t *>(&header), sizeof(header)) == sizeof(header) &&
+                     header.magic == CONFIG_MAGIC &&
+                     header.version == CONFIG_VERSION &&
+                     header.size == sizeof(ConfigData) &&
+                     sourcefile.read(reinterpret_cast<uint8_t *>(&data), sizeof(data)) == sizeof(data) &&
+                     header.crc == _crc32(reinterpret_cast<const uint8_t *>(&data), sizeof(data));
+        sourcefile.close();
+        if (!valid)
+        {
+                Serial.println(F("Stored config is invalid or outdated"));
+                return false;
+        }
+
+        Config::writeCount = header.writeCount;
+        Config::_publish(data);
+        return true;
+}
+
+// Imports data.json, or the defaults if there is none
+bool Config::loadJSON()
+{
+        File sourcefile = CONFIG_FS.open(CONFIG_JSON_FILE, "r");
 
         // Allocate a temporary JsonDocument
         // Don't forget to change the capacity to match your requirements.
@@ -387,60 +868,121 @@ void Config::load()
         DeserializationError error = deserializeJson(doc, sourcefile);
         doc.shrinkToFit();
         Config::JSONToConfig(doc);
-        if (error)
+        // Close the file (Curiously, File's destructor doesn't close the file)
+        sourcefile.close();
+        return !error;
+}
+
+void Config::load()
+{
+        if (Config::loadBinary())
+        {
+                return;
+        }
+
+        // A config.bin that was written once and is broken now falls back
+        // to the defaults. data.json only holds the settings from the time
+        // of the migration, which may be long outdated.
+        if (CONFIG_FS.exists(CONFIG_BIN_FILE))
+        {
+                Serial.println(F("Stored config is broken, using default configuration"));
+                DynamicJsonDocument doc(64);
+                Config::JSONToConfig(doc);
+        }
+        // First boot after the update: migrate the JSON config and store
+        // it in the binary format. data.json is kept, so a firmware
+        // without config.bin still finds its settings.
+        else if (!Config::loadJSON())
         {
-                sourcefile.close();
                 Serial.println(F("Failed to read file, using default configuration"));
+        }
+        Config::save();
+}
+
+// Marks the config for saving, flush() writes it once the changes have
+// settled. Changes that need a reboot are written right away.
+void Config::requestSave()
+{
+        uint32_t now = millis();
+        if (!Config::savePending)
+        {
+                Config::savePending = true;
+                Config::_firstSaveRequest = now;
+        }
+        Config::_lastSaveRequest = now;
+        if (Config::_resetRequest)
+        {
                 Config::save();
-                return;
         }
-        // Copy values from the JsonDocument to the Config
-        // Close the file (Curiously, File's destructor doesn't close the file)
-        sourcefile.close();
-        Config::locked = false;
 }
 
+// Writes a pending save when it is due, returns true if it did
+bool Config::flush()
+{
+        if (!Config::savePending)
+        {
+                return false;
+        }
+        uint32_t now = millis();
+        if (now - Config::_lastSaveRequest < SAVE_QUIET_MS &&
+            now - Config::_firstSaveRequest < SAVE_MAX_DELAY_MS)
+        {
+                return false;
+        }
+        Config::save();
+        return true;
+}
+
+// Writes config.bin through a temporary file, so a power loss while
+// saving leaves the previous config in place
 void Config::save()
 {
         bool format = false;
-        // Delete existing file, otherwise the configuration is appended to the file
-        Config::locked = true;
-#if defined(ESP8266)
-        File targetfile = LittleFS.open("data.json", "w");
-#elif defined(ESP32)
-        File targetfile = SPIFFS.open("/data.json", "w");
-#endif
+        const ConfigData &data = *Config::_published;
+        uint32_t start = micros();
+
+        ConfigHeader header;
+        header.magic = CONFIG_MAGIC;
+        header.version = CONFIG_VERSION;
+        header.size = sizeof(ConfigData);
+        header.crc = _crc32(reinterpret_cast<const uint8_t *>(&data), sizeof(data));
+        header.writeCount = Config::writeCount + 1;
 
-        // Open file for writing
+        File targetfile = CONFIG_FS.open(CONFIG_TMP_FILE, "w");
         if (!targetfile)
         {
                 Serial.println(F("Failed to create config file. Reformatting FS and rebooting."));
                 format = true;
-
         }
-
-        DynamicJsonDocument doc(2048);
-        Config::configToJSON(doc);
-        doc.shrinkToFit();
-        // Serialize JSON to file
-        if (serializeJson(doc, targetfile) == 0)
+        else if (targetfile.write(reinterpret_cast<const uint8_t *>(&header), sizeof(header)) != sizeof(header) ||
+                 targetfile.write(reinterpret_cast<const uint8_t *>(&data), sizeof(data)) != sizeof(data))
         {
                 Serial.println(F("Failed to write to config file. Reformatting FS and rebooting."));
                 format = true;
+        }
+        targetfile.close();
 
+        if (!format)
+        {
+#if defined(ESP32)
+                // SPIFFS does not replace existing files on rename
+                CONFIG_FS.remove(CONFIG_BIN_FILE);
+#endif
+                if (!CONFIG_FS.rename(CONFIG_TMP_FILE, CONFIG_BIN_FILE))
+                {
+                        Serial.println(F("Failed to replace config file. Reformatting FS and rebooting."));
+                        format = true;
+                }
         }
-        if (format) {
-#if defined(ESP8266)
-                LittleFS.format();
-                ESP.restart();
-#elif defined(ESP32)
-                SPIFFS.format();
+        if (format)
+        {
+                CONFIG_FS.format();
                 ESP.restart();
-#endif
         }
 
-        // Close the file
-        targetfile.close();
-        Config::locked = false;
+        Config::writeCount = header.writeCount;
+        Config::saveCount++;
+        Config::savePending = false;
+        Config::lastSaveDuration = micros() - start;
         Config::forceReset = Config::_resetRequest;
 }
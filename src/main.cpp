@@ -15,10 +15,17 @@
 #include "webserver.hpp"
 #include "config.hpp"
 #include "mqtt.hpp"
+#include "stats.hpp"
+#include "realtime.hpp"
+#include "wallclock.hpp"
+#include "scheduler.hpp"
+#include "ntp.hpp"
+#include "resolver.hpp"
 #include "vars.hpp"
 #include "timefunc.hpp"
 #include "color.hpp"
 #include "led.hpp"
+#include "render.hpp"
 
 #if defined(ESP8266)
 extern "C"
@@ -34,130 +41,6 @@ extern "C"
 }
 #endif
 
-void renderSecondsHand(int s)
-{
-  uint8_t secondsHand = (s + config.config.ledRoot) % 60;
-  if (config.config.fluidMotion)
-  {
-    HsbColor currentPixelColor, upcomingPixelColor;
-    currentPixelColor = upcomingPixelColor = HsbColor(secondColor);
-    float maxBrightness = currentPixelColor.B;
-    float brightnessStep = maxBrightness / 60;
-    float brightness = min(float(frame * brightnessStep), (float)maxBrightness);
-    currentPixelColor.B = maxBrightness - brightness;
-    upcomingPixelColor.B = brightness;
-
-    uint8_t nextPixel = (secondsHand + 1) % 60;
-    setPixel(secondsHand, currentPixelColor, config.config.blendColors);
-    setPixel(nextPixel, upcomingPixelColor, config.config.blendColors);
-  }
-  else
-  {
-    setPixel(secondsHand, secondColor, config.config.blendColors);
-  }
-}
-
-uint8_t calculateMinuteHand(int m)
-{
-  uint8_t minuteHand = m;
-  minuteHand = (minuteHand + config.config.ledRoot) % 60;
-  return minuteHand;
-}
-
-void renderHourHand(int h, int m)
-{
-  uint8_t hour = h % 12;
-  uint8_t hourHand = floor((float)60 / 12 * hour);
-  uint8_t minuteOffset = floor((float)m * 60 / 12 / 60);
-  hourHand = (hourHand + minuteOffset + config.config.ledRoot) % 60;
-  int8_t nextPixel = (hourHand + 1) % 60;
-  int8_t prevPixel = (hourHand - 1) % 60;
-
-  if (prevPixel == -1)
-  {
-    prevPixel = 59;
-  }
-
-  if (strcmp(config.config.hourHandStyle, "split") == 0)
-  {
-    setPixel(prevPixel, hourColor, config.config.blendColors);
-    setPixel(nextPixel, hourColor, config.config.blendColors);
-  }
-  else if (strcmp(config.config.hourHandStyle, "wide") == 0)
-  {
-    RgbColor dim = hourColor.Dim(32);
-    setPixel(prevPixel, dim, config.config.blendColors);
-    setPixel(hourHand, hourColor, config.config.blendColors);
-    setPixel(nextPixel, dim, config.config.blendColors);
-  }
-  else
-  {
-    setPixel(hourHand, hourColor, config.config.blendColors);
-  }
-}
-
-uint8_t calculateDayHand()
-{
-  return config.config.dayOffset + day() - 1;
-}
-
-uint8_t calculateMonthHand()
-{
-  return config.config.monthOffset + month() - 1;
-}
-
-uint8_t calculateWeekdayHand()
-{
-  // correct weekday to be using 0 for monday and 7 for sunday
-  uint8_t dow = localTime.weekday();
-  dow--;
-  if (dow == 0)
-  {
-    dow = 7;
-  }
-  return config.config.weekdayOffset + dow - 1;
-}
-
-void renderHourDots()
-{
-  float step = (float)60 / 12;
-  for (size_t i = 0; i < 12; i++)
-  {
-    uint8_t dotPos = (uint8_t)floor(step * i);
-    dotPos = (dotPos + config.config.ledRoot) % 60;
-    if (i % 3 == 0 && config.config.hourQuarter)
-    {
-      strip->SetPixelColor(dotPos, quarter);
-    }
-    else if (config.config.hourDot)
-    {
-      strip->SetPixelColor(dotPos, dot);
-    }
-  }
-}
-
-void renderHourSegment(uint8_t h)
-{
-
-  uint8_t hour12 = h % 12;
-  uint8_t segmentLength = floor((float)60 / 12);
-  uint8_t segmentStart = floor((float)60 / 12 * hour12);
-  segmentStart = (segmentStart + config.config.ledRoot) % 60;
-  for (size_t i = 0; i < segmentLength; i++)
-  {
-    strip->SetPixelColor(segmentStart + i, segment);
-  }
-}
-
-void setBacklight()
-{
-  bgStrip->ClearTo(off);
-  for (size_t i = 0; i < config.config.bgLedCount; i++)
-  {
-    bgStrip->SetPixelColor(i, bgColor);
-  }
-}
-
 void printDebugInfo()
 {
 #ifdef DEBUG_BUILD
@@ -176,57 +59,75 @@ void printDebugInfo()
 #endif
   Serial.print("Uptime: ");
   Serial.println(int(millis() / 1000));
+  Serial.print("Frames rendered/late/dropped: ");
+  Serial.print(frameStats.rendered);
+  Serial.print(" / ");
+  Serial.print(frameStats.late);
+  Serial.print(" / ");
+  Serial.println(frameStats.dropped);
+  Serial.print("MaxJitter: ");
+  Serial.println(frameStats.maxJitter);
+  Serial.print("SkippedFrames: ");
+  Serial.print(skippedFrames);
+  Serial.print(" / ");
+  Serial.println(skippedBgFrames);
   Serial.println("====");
 #endif
 }
 
-void showStrips()
+// Starts looking up the time server, pollNtp() starts asking it once the
+// answer came. The lookup does not wait, but it still costs a DNS query,
+// so besides on start and on a new server it only happens at a minute
+// boundary, and then only while no server was found or the last one
+// stopped answering.
+void beginNtp()
 {
+  ntpResolver.begin(config.config.timeserver, millis());
+  ntpResolving = true;
+}
 
-  while (!strip->CanShow())
+// Keeps ezTime, which only converts time zones here, at the time of the
+// wall clock and plans the events again after the time jumped
+void pollNtp()
+{
+  if (ntpResolving)
   {
-    delay(1);
+    uint8_t found = ntpResolver.poll(millis());
+    if (found != RESOLVE_PENDING)
+    {
+      ntpResolving = false;
+      if (found == RESOLVE_DONE)
+      {
+        ntp.begin(ntpResolver.address());
+      }
+    }
   }
-
-  strip->Show();
-  while (!bgStrip->CanShow())
+  uint8_t result = ntp.poll(micros());
+  if (result == NTP_NONE)
   {
-    delay(1);
+    return;
   }
-  bgStrip->Show();
-}
-void clearStrips()
-{
-  strip->ClearTo(off);
-  bgStrip->ClearTo(off);
-}
-
-void shiftStrips(uint8_t frameskip = 1)
-{
-  if (frame % frameskip == 0)
+  UTC.setTime(wallClock.utc(), wallClock.ms(micros()));
+  if (result == NTP_STEPPED)
   {
-    strip->RotateRight(1);
-    if (config.config.bgLight)
-      bgStrip->RotateRight(1);
+    scheduler.plan(config.config, wallClock.utc());
   }
 }
 
-void renderTime()
+int32_t zoneOffset(uint32_t utc)
 {
-  if (config.config.hourDot)
-    renderHourDots();
-  if (config.config.hourSegment)
-    renderHourSegment(currentHour);
+  return localTime.tzTime(utc, UTC_TIME) - utc;
+}
 
-  renderHourHand(currentHour, currentMinute);
-  setPixel(calculateMinuteHand(currentMinute), minuteColor, config.config.blendColors);
-  renderSecondsHand(currentSecond);
-  if (config.config.dayMonth)
-  {
-    setPixel(currentDayPos, dayColor, config.config.blendColors);
-    setPixel(currentMonthPos, monthColor, config.config.blendColors);
-    setPixel(currentWeekdayPos, weekdayColor, config.config.blendColors);
-  }
+void setupScheduler()
+{
+  scheduler.setZone(zoneOffset);
+  scheduler.on(EVENT_DST, []()
+               { wallClock.setOffset(scheduler.offset()); });
+  scheduler.on(EVENT_NIGHT, []()
+               { night = scheduler.night(); updateColors(night); });
+  scheduler.on(EVENT_ALARM, []()
+               { alarm = scheduler.alarm(); });
 }
 
 void setup()
@@ -242,6 +143,9 @@ void setup()
   SPIFFS.begin(true);
 #endif
   config.load();
+  config.snapshot();
+  buildPositions(config.config);
+  config.dirty = 0;
   initStrip();
   clearStrips();
   char hostname[64];
@@ -261,24 +165,44 @@ void setup()
 #ifdef DEBUG_BUILD
   setDebug(DEBUG);
 #endif
-  setServer(config.config.timeserver);
-  setInterval(20000);
-  waitForSync(10);
-
-  Serial.println("UTC: " + UTC.dateTime());
+  // the time comes from NtpClient, ezTime would block the loop to sync
+  setInterval(0);
   localTime.setLocation(config.config.timezone);
   localTime.setDefault();
-  webserver.setup(config);
+  setupScheduler();
+  // the clock runs from 1970 until the first NTP reply steps it, so the
+  // minute boundaries that retry the lookup of the time server come
+  wallClock.sync(0, micros());
+  scheduler.plan(config.config, wallClock.utc());
+  beginNtp();
+  stats.frames = &frameStats;
+  stats.ntp = &ntp.stats;
+  webserver.setup(config, stats, mqtt);
   mqtt.setup(config);
+  realtime.resize(config.config.ledCount, config.config.bgLedCount);
+  realtime.begin();
+  stats.realtime = &realtime.stats;
   MDNS.begin(hostname);
   MDNS.addService("ESPCLOCK", "tcp", 80);
   MDNS.addService("http", "tcp", 80);
-  updateColors(isNight(hour(), minute()));
+  setFrameRate(config.config.frameRate);
+}
+
+// Records the render stage, shows the strips and the live preview and
+// records that as well.
+void showFrame(uint32_t &stageStart)
+{
+  stageStart = stats.record(STAGE_RENDER, stageStart);
+  showStrips();
+  webserver.publishFrame(strip->Pixels(), strip->PixelCount(), bgStrip->Pixels(), bgStrip->PixelCount());
+  stageStart = stats.record(STAGE_SHOW, stageStart);
 }
 
 void loop()
 {
+  uint32_t stageStart = micros();
   webserver.handleRequest();
+  stageStart = stats.record(STAGE_WEBSERVER, stageStart);
   if (webserver.triggerWifiConf)
   {
     clearStrips();
@@ -289,106 +213,171 @@ void loop()
     wifiManager.startConfigPortal(apname);
   }
 
-  if (!config.locked)
-  {
+  // the handlers above publish config changes, the rest of the pass
+  // works on a consistent copy
+  config.snapshot();
 
-    uint8_t s = second();
+  stageStart = micros();
 
-    if (config.tainted)
+  // rebuild only the state that depends on the changed settings
+  uint16_t dirty = config.dirty;
+  if (dirty != 0)
+  {
+    config.dirty = 0;
+    if (dirty & CONFIG_DIRTY_STRIP)
+    {
+      initStrip();
+      realtime.resize(config.config.ledCount, config.config.bgLedCount);
+    }
+    if (dirty & (CONFIG_DIRTY_STRIP | CONFIG_DIRTY_GEOMETRY))
+    {
+      buildPositions(config.config);
+      currentDayPos = calculateDayHand();
+      currentMonthPos = calculateMonthHand();
+      currentWeekdayPos = calculateWeekdayHand();
+      compositor.invalidate(LAYERS_ALL);
+    }
+    if (dirty & (CONFIG_DIRTY_ALARM | CONFIG_DIRTY_NIGHT))
+    {
+      scheduler.plan(config.config, wallClock.utc());
+    }
+    if (dirty & (CONFIG_DIRTY_COLORS | CONFIG_DIRTY_NIGHT))
     {
-      alarm = isAlarm();
-      uint8_t m = minute();
-      uint8_t h = hour();
-      night = isNight(h, m);
       updateColors(night);
-      mqtt.connect(config);
+    }
+    if (dirty & CONFIG_DIRTY_TIMING)
+    {
+      setFrameRate(config.config.frameRate);
+    }
+    if (dirty & CONFIG_DIRTY_MQTT)
+    {
+      mqtt.reconfigure(config);
+    }
+    if (dirty & CONFIG_DIRTY_SYSTEM)
+    {
+      beginNtp();
+    }
+    // color changes come in bursts while a slider moves, they are
+    // published once they get saved
+    if (dirty & ~CONFIG_DIRTY_COLORS)
+    {
       mqtt.publishConfig(config);
-      config.tainted = false;
-    };
+    }
+    mqtt.publishFields(config);
+    stageStart = stats.record(STAGE_CONFIG, stageStart);
+  }
+
+  if (config.flush())
+  {
+    mqtt.publishConfig(config);
+    stageStart = stats.record(STAGE_CONFIG, stageStart);
+  }
 
-    if (currentSecond != s)
+  uint8_t boundaries = wallClock.update(micros());
+  if (boundaries & CLOCK_SECOND)
+  {
+    // a change of daylight saving time moves the local time
+    scheduler.update(wallClock.utc());
+    boundaries |= wallClock.update(micros());
+    currentSecond = wallClock.second();
+    frame = 0;
+    secondStart = wallClock.secondStart();
+    compositor.invalidate(LAYER_BIT(LAYER_HANDS));
+    if ((boundaries & CLOCK_MINUTE) && !ntpResolving && (!ntp.started() || ntp.needsResolve()))
     {
-      currentSecond = s;
-      alarm = isAlarm();
-      frame = 0;
-      uint8_t m = minute();
-      mqtt.connect(config);
+      beginNtp();
+    }
+    mqtt.connect(config);
 #ifdef DEBUG_BUILD
-      mqtt.publishUptime();
+    mqtt.publishUptime();
 #endif
 
-      if (currentMinute != m)
-      {
-        currentMinute = m;
-        uint8_t h = hour();
+    if (boundaries & CLOCK_MINUTE)
+    {
+      currentMinute = wallClock.minute();
+      topHour = (config.config.hourLight && currentMinute == 0);
+      printDebugInfo();
+    }
+    if (boundaries & CLOCK_HOUR)
+    {
+      currentHour = wallClock.hour();
+      compositor.invalidate(LAYER_BIT(LAYER_MARKERS));
+    }
+    if (boundaries & CLOCK_DAY)
+    {
+      currentDayPos = calculateDayHand();
+      currentMonthPos = calculateMonthHand();
+      currentWeekdayPos = calculateWeekdayHand();
+      compositor.invalidate(LAYER_BIT(LAYER_DATE));
+    }
+    stageStart = stats.record(STAGE_ROLLOVER, stageStart);
+  }
 
-        night = isNight(h, m);
-        topHour = (config.config.hourLight && currentMinute == 0);
-        updateColors(night);
-        printDebugInfo();
+  stageStart = micros();
+  realtime.receive(millis());
+  stats.record(STAGE_REALTIME, stageStart);
 
-        if (currentHour != h)
-        {
-          currentHour = h;
-          currentDayPos = calculateDayHand();
-          currentMonthPos = calculateMonthHand();
-          currentWeekdayPos = calculateWeekdayHand();
-        }
-      }
+  if (tick())
+  {
+    stageStart = micros();
+    ClockMode mode = MODE_TIME;
+    if (alarm || mqtt.command == MODE_ALARM)
+      mode = MODE_ALARM;
+    else if (realtime.active(millis()))
+      mode = MODE_REALTIME;
+    else if (topHour || mqtt.command == MODE_RAINBOW)
+      mode = MODE_RAINBOW;
+    else if (mqtt.command == MODE_OFF)
+      mode = MODE_OFF;
+
+    // a new mode starts its animation from scratch, the time gets
+    // composed again from its cached layers
+    if (mode != currentMode)
+    {
+      currentMode = mode;
+      animation.stop();
+      compositor.recompose();
     }
 
-    if (tick())
+    switch (mode)
     {
-      if (alarm || strcmp(mqtt.currentCommand, "alarm") == 0)
-      {
-        if (!animationRendered)
-        {
-          renderAlarm(night);
-          if (config.config.bgLight)
-            renderAlarm(night, true);
-          animationRendered = true;
-          showStrips();
-          mqtt.publishStatus("alarm");
-          return;
-        }
-        shiftStrips(2);
-        showStrips();
-      }
-
-      else if (topHour || strcmp(mqtt.currentCommand, "rainbow") == 0)
-      {
-        if (!animationRendered)
-        {
-          renderRainbow(night);
-          if (config.config.bgLight)
-            renderRainbow(night, true);
-          animationRendered = true;
-          showStrips();
-          mqtt.publishStatus("rainbow");
-          return;
-        }
-        shiftStrips(2);
-        showStrips();
-      }
-      else if (strcmp(mqtt.currentCommand, "off") == 0)
-      {
-        clearStrips();
-        showStrips();
-        mqtt.publishStatus("off");
-      }
-
-      else
-      {
-        animationRendered = false;
-        clearStrips();
-        renderTime();
-        setBacklight();
-        showStrips();
-        mqtt.publishStatus("time");
-      }
+    case MODE_ALARM:
+      renderAnimation(alarmEffect);
+      showFrame(stageStart);
+      break;
+
+    case MODE_RAINBOW:
+      renderAnimation(rainbowEffect);
+      showFrame(stageStart);
+      break;
+
+    case MODE_REALTIME:
+      // the frame is copied into the pixel buffers behind the back of the strips
+      realtime.present(strip->Pixels(), bgStrip->Pixels(), millis());
+      strip->Dirty();
+      bgStrip->Dirty();
+      showFrame(stageStart);
+      break;
+
+    case MODE_OFF:
+      clearStrips();
+      showFrame(stageStart);
+      break;
+
+    default:
+      renderTime();
+      setBacklight();
+      showFrame(stageStart);
+      break;
     }
+    mqtt.publishState({mode, night, alarm});
   }
+  stageStart = micros();
   mqtt.loop();
+  stageStart = stats.record(STAGE_MQTT, stageStart);
   MDNS.update();
+  stageStart = stats.record(STAGE_MDNS, stageStart);
+  pollNtp();
   events();
+  stats.record(STAGE_EVENTS, stageStart);
 }
\ No newline at end of file
@@ -10,24 +10,32 @@ void Mqtt::_handleRequest(char *topic, byte *payload, unsigned int length, Confi
     {
         if (strncmp((char *)payload, "alarm", length) == 0)
         {
-            strlcpy(currentCommand, "alarm", sizeof(currentCommand));
+            command = MODE_ALARM;
         }
         else if (strncmp((char *)payload, "rainbow", length) == 0)
         {
-            strlcpy(currentCommand, "rainbow", sizeof(currentCommand));
+            command = MODE_RAINBOW;
         }
         else if (strncmp((char *)payload, "off", length) == 0)
         {
-            strlcpy(currentCommand, "off", sizeof(currentCommand));
+            command = MODE_OFF;
         }
         else if (strncmp((char *)payload, "getConfig", length) == 0)
         {
-            strlcpy(currentCommand, "time", sizeof(currentCommand));
+            command = MODE_TIME;
             publishConfig(config);
         }
         else
         {
-            strlcpy(currentCommand, "time", sizeof(currentCommand));
+            command = MODE_TIME;
+        }
+    }
+    else if (strncmp(topic, setFieldTopic, strlen(setFieldTopic)) == 0)
+    {
+        // the loop publishes the new value with the other changed fields
+        if (config.setField(topic + strlen(setFieldTopic), (char *)payload))
+        {
+            config.requestSave();
         }
     }
     else if (strncmp(topic, setConfigTopic, sizeof(setConfigTopic)) == 0)
@@ -36,15 +44,26 @@ void Mqtt::_handleRequest(char *topic, byte *payload, unsigned int length, Confi
         DynamicJsonDocument doc(2048);
         deserializeJson(doc, (char *)payload, length);
         bool save = config.JSONToConfig(doc);
-        config.tainted = true;
         if (save)
         {
-            config.save();
+            config.requestSave();
         }
         publishConfig(config);
     }
+    else if (strncmp(topic, patchConfigTopic, sizeof(patchConfigTopic)) == 0)
+    {
+        DynamicJsonDocument changes(Config::patchCapacity(length));
+        if (!config.patchJSON((const char *)payload, length, changes))
+        {
+            return;
+        }
+        publishConfigChanges(changes);
+    }
 }
 
+// Starts an attempt unless connected already or an attempt is under
+// way. After a failed attempt the next one waits for the backoff. loop()
+// carries the attempt on, only the login waits for the broker.
 bool Mqtt::connect(Config &config)
 {
     Mqtt::_isEnabled = config.config.mqttActive;
@@ -58,29 +77,121 @@ bool Mqtt::connect(Config &config)
     {
         return true;
     }
-    else
+    if (_resolving || _connecting)
     {
-        bool connected = _mqttClient.connect(config.config.hostname, config.config.mqttUser, config.config.mqttPassword, statusTopic, 0, true, "shutdown");
-        if (connected)
+        return false;
+    }
+    uint32_t now = millis();
+    if (!_backoff.due(now))
+    {
+        return false;
+    }
+    connectAttempts++;
+    _config = &config;
+    _resolver.begin(config.config.mqttServer, now);
+    _resolving = true;
+    return false;
+}
+
+// Moves a running attempt on from the DNS lookup over the TCP connect to
+// the login, as far as it gets without waiting
+void Mqtt::_advance()
+{
+    uint32_t now = millis();
+    if (_resolving)
+    {
+        uint8_t result = _resolver.poll(now);
+        if (result == RESOLVE_PENDING)
         {
-            publishStatus("online");
-            _mqttClient.subscribe(setConfigTopic);
-            _mqttClient.subscribe(commandTopic);
-            _mqttClient.setCallback([this, &config](char *topic, byte *payload, unsigned int length)
-                                    { _handleRequest(topic, payload, length, config); });
+            return;
         }
-        return connected;
-    };
+        _resolving = false;
+        if (result != RESOLVE_DONE)
+        {
+            _failed();
+            return;
+        }
+        if (!_tcp.open(_resolver.address(), _config->config.mqttPort))
+        {
+            _failed();
+            return;
+        }
+        _connecting = true;
+        _connectStart = now;
+    }
+    if (!_connecting)
+    {
+        return;
+    }
+    uint8_t status = _tcp.status();
+    if (status == TCP_OPEN)
+    {
+        _connecting = false;
+        _onConnected(*_config);
+    }
+    else if (status == TCP_FAILED || now - _connectStart >= MQTT_CONNECT_TIMEOUT_MS)
+    {
+        _connecting = false;
+        _failed();
+    }
+}
+
+// The socket is open, PubSubClient logs in on it. Its connect() finds the
+// client connected and only sends CONNECT and waits for the CONNACK, for
+// at most MQTT_HANDSHAKE_TIMEOUT_S. That is one round trip to a broker
+// that just accepted the connection, the unreachable broker and the slow
+// DNS lookup that used to block the loop never get this far.
+void Mqtt::_onConnected(Config &config)
+{
+    if (!_mqttClient.connect(config.config.hostname, config.config.mqttUser, config.config.mqttPassword, statusTopic, 0, true, "shutdown"))
+    {
+        _failed();
+        return;
+    }
+    _backoff.reset();
+    connectCount++;
+    lastConnect = millis();
+    publishStatus("online");
+    // the retained status now says online, send the state again
+    _statePublished = false;
+    _fieldsUnsent = MQTT_ALL_FIELDS;
+    _mqttClient.subscribe(setConfigTopic);
+    char fieldFilter[sizeof(setFieldTopic) + 1];
+    snprintf(fieldFilter, sizeof(fieldFilter), "%s#", setFieldTopic);
+    _mqttClient.subscribe(fieldFilter);
+    _mqttClient.subscribe(patchConfigTopic);
+    _mqttClient.subscribe(commandTopic);
+    _mqttClient.setCallback([this, &config](char *topic, byte *payload, unsigned int length)
+                            { _handleRequest(topic, payload, length, config); });
+    publishFields(config);
+}
+
+void Mqtt::_failed()
+{
+    _tcp.close();
+    connectFailures++;
+    _backoff.failed(millis());
+}
+
+bool Mqtt::connected()
+{
+    return Mqtt::_isEnabled && _mqttClient.connected();
 }
 
 bool Mqtt::setup(Config &config)
 {
-    _mqttClient.setClient(_wifiClient);
-    _mqttClient.setServer(config.config.mqttServer, config.config.mqttPort);
+    // the attempts open the socket, PubSubClient needs no server and
+    // never waits for the connect
+    _mqttClient.setClient(_tcp);
     _mqttClient.setBufferSize(2560);
+    _mqttClient.setSocketTimeout(MQTT_HANDSHAKE_TIMEOUT_S);
     snprintf(configTopic, sizeof(configTopic), "%s/config", config.config.mqttBaseTopic);
     snprintf(setConfigTopic, sizeof(setConfigTopic), "%s/setConfig", config.config.mqttBaseTopic);
+    snprintf(patchConfigTopic, sizeof(patchConfigTopic), "%s/patchConfig", config.config.mqttBaseTopic);
+    snprintf(configChangesTopic, sizeof(configChangesTopic), "%s/configChanges", config.config.mqttBaseTopic);
+    snprintf(setFieldTopic, sizeof(setFieldTopic), "%s/set/", config.config.mqttBaseTopic);
     snprintf(statusTopic, sizeof(statusTopic), "%s/status", config.config.mqttBaseTopic);
+    snprintf(stateTopic, sizeof(stateTopic), "%s/state", config.config.mqttBaseTopic);
     snprintf(commandTopic, sizeof(commandTopic), "%s/command", config.config.mqttBaseTopic);
 #ifdef DEBUG_BUILD
     snprintf(debugTopic, sizeof(debugTopic), "%s/debug", config.config.mqttBaseTopic);
@@ -96,11 +207,23 @@ bool Mqtt::setup(Config &config)
     };
 }
 
-void Mqtt::publish(const char *message, const char *topic, bool retain)
+// Drops the connection or attempt and sets up the client again with the
+// changed server, credentials and topics. The new attempt only starts.
+bool Mqtt::reconfigure(Config &config)
+{
+    _mqttClient.disconnect();
+    _tcp.close();
+    _resolving = false;
+    _connecting = false;
+    _backoff.reset();
+    return setup(config);
+}
+
+bool Mqtt::publish(const char *message, const char *topic, bool retain)
 {
     if (!Mqtt::_isEnabled || !_mqttClient.connected())
-        return;
-    _mqttClient.publish(topic, message, retain);
+        return false;
+    return _mqttClient.publish(topic, message, retain);
 }
 
 void Mqtt::publishConfig(Config &config)
@@ -115,6 +238,63 @@ void Mqtt::publishConfig(Config &config)
     publish(response, configTopic, false);
 }
 
+// Publishes every scalar field to (BASETOPIC)/config/<field> that changed
+// since it was last published, all of them after connecting. Only
+// MQTT_FIELDS_PER_PASS go out per call, loop() carries on with the rest,
+// so a reconnect neither stalls a frame nor overflows the send buffer.
+void Mqtt::publishFields(Config &config)
+{
+    _config = &config;
+    _fieldsPending = true;
+}
+
+static_assert(CONFIG_FIELD_COUNT < 64, "Mqtt::_fieldsUnsent has one bit per field");
+
+// Publishes the next fields that need it, starting where the last call
+// stopped. A field whose publish failed is tried again on the next pass.
+void Mqtt::_publishFields()
+{
+    char topic[sizeof(configTopic) + 32];
+    char value[12];
+    uint8_t sent = 0;
+    for (uint8_t n = 0; n < CONFIG_FIELD_COUNT; n++)
+    {
+        uint8_t i = _fieldCursor;
+        uint32_t current = _config->fieldValue(i);
+        if ((_fieldsUnsent & (1ULL << i)) || current != _fieldValues[i])
+        {
+            if (sent == MQTT_FIELDS_PER_PASS)
+                return;
+            snprintf(topic, sizeof(topic), "%s/%s", configTopic, Config::fieldName(i));
+            snprintf(value, sizeof(value), "%u", (unsigned)current);
+            if (!publish(value, topic, true))
+                return;
+            _fieldValues[i] = current;
+            _fieldsUnsent &= ~(1ULL << i);
+            sent++;
+        }
+        _fieldCursor = (i + 1) % CONFIG_FIELD_COUNT;
+    }
+    _fieldsPending = false;
+}
+
+// Publishes the fields changed by a patch, leaving out the same sensitive
+// fields as publishConfig
+void Mqtt::publishConfigChanges(JsonDocument &changes)
+{
+    if (!Mqtt::_isEnabled || !_mqttClient.connected())
+        return;
+    static const char *sensitiveKeys[] = {"hostname", "timeserver", "timezone", "mqttActive", "mqttServer",
+                                          "mqttUser", "mqttPassword", "mqttPort", "mqttBaseTopic"};
+    for (const char *key : sensitiveKeys)
+    {
+        changes.remove(key);
+    }
+    char response[measureJson(changes) + 1];
+    serializeJson(changes, response, sizeof(response));
+    publish(response, configChangesTopic, false);
+}
+
 #ifdef DEBUG_BUILD
 void Mqtt::publishUptime()
 {
@@ -137,9 +317,33 @@ void Mqtt::publishStatus(const char *status)
     }
 }
 
+// Publishes the mode as status and the full state as compact JSON, but
+// only when something changed since the last call
+void Mqtt::publishState(const ClockState &state)
+{
+    if (_statePublished && state == _lastState)
+        return;
+    if (!connected())
+        return;
+    publishStatus(modeNames[state.mode]);
+    char payload[48];
+    snprintf(payload, sizeof(payload), "{\"mode\":\"%s\",\"night\":%d,\"alarm\":%d}",
+             modeNames[state.mode], state.night, state.alarm);
+    publish(payload, stateTopic, true);
+    _lastState = state;
+    _statePublished = true;
+}
+
 void Mqtt::loop()
 {
-    if (!Mqtt::_isEnabled || !_mqttClient.connected())
+    if (!Mqtt::_isEnabled)
+        return;
+    _advance();
+    // packets the stack had no room for go out as it gets some
+    _tcp.flush();
+    if (!_mqttClient.connected())
         return;
     _mqttClient.loop();
+    if (_fieldsPending)
+        _publishFields();
 }
\ No newline at end of file
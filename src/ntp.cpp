@@ -0,0 +1,183 @@
+#include "ntp.hpp"
+
+#define NTP_UNIX_OFFSET 2208988800UL // seconds from 1900 to 1970
+#define NTP_CLIENT_HEADER 0x23       // no leap second warning, version 4, client mode
+#define NTP_LEAP_UNSYNCHRONIZED 3
+#define NTP_MODE_SERVER 4
+
+// Offsets into an NTP packet
+#define NTP_ORIGINATE 24
+#define NTP_RECEIVE 32
+#define NTP_TRANSMIT 40
+
+// Packets read per loop pass, so a flood cannot stall the loop
+#define NTP_PACKETS_PER_PASS 4
+
+static uint64_t _read64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+static void _write64(uint8_t *p, uint64_t value)
+{
+    for (int8_t i = 7; i >= 0; i--)
+    {
+        p[i] = value;
+        value >>= 8;
+    }
+}
+
+// µs since 1970 to the 32.32 fixed point seconds since 1900 of NTP
+static uint64_t _toNtp(uint64_t time)
+{
+    uint64_t seconds = (time / 1000000 + NTP_UNIX_OFFSET) & 0xFFFFFFFF;
+    uint64_t fraction = ((time % 1000000) << 32) / 1000000;
+    return seconds << 32 | fraction;
+}
+
+// The seconds wrap with the NTP era in 2036 and stay right until 2106
+static uint64_t _fromNtp(uint64_t ntp)
+{
+    uint32_t seconds = (uint32_t)(ntp >> 32) - NTP_UNIX_OFFSET;
+    return (uint64_t)seconds * 1000000 + (((ntp & 0xFFFFFFFF) * 1000000 + 0x80000000) >> 32);
+}
+
+NtpClient::NtpClient(WallClock &clock) : _clock(clock)
+{
+}
+
+// Starts asking server for the time with the next poll()
+void NtpClient::begin(IPAddress server, uint16_t port)
+{
+    _server = server;
+    _port = port;
+    _waiting = false;
+    _timeoutsInRow = 0;
+    _sampled = false;
+    // any free local port will do
+    _udp.begin(0);
+    _due = micros();
+}
+
+// Sends a request when one is due or handles the reply to the last one,
+// returns how the wall clock got corrected
+uint8_t NtpClient::poll(uint32_t now)
+{
+    if (_server == 0)
+    {
+        return NTP_NONE;
+    }
+    if (_waiting)
+    {
+        uint8_t result = _receive(now);
+        if (_waiting && now - _sent >= NTP_TIMEOUT_US)
+        {
+            _waiting = false;
+            _due = now + NTP_RETRY_US;
+            stats.timeouts++;
+            if (_timeoutsInRow < NTP_RESOLVE_TIMEOUTS)
+            {
+                _timeoutsInRow++;
+            }
+        }
+        return result;
+    }
+    if ((int32_t)(now - _due) >= 0)
+    {
+        _send(now);
+    }
+    return NTP_NONE;
+}
+
+// The transmit timestamp is the time of the wall clock, the server
+// returns it as the originate timestamp of its reply
+void NtpClient::_send(uint32_t now)
+{
+    uint8_t packet[NTP_PACKET_SIZE] = {};
+    packet[0] = NTP_CLIENT_HEADER;
+    _originate = _toNtp(_clock.time(now));
+    _write64(packet + NTP_TRANSMIT, _originate);
+
+    _udp.beginPacket(IPAddress(_server), _port);
+    _udp.write(packet, sizeof(packet));
+    _udp.endPacket();
+    _sent = now;
+    _waiting = true;
+    stats.requests++;
+}
+
+uint8_t NtpClient::_receive(uint32_t now)
+{
+    for (uint8_t i = 0; i < NTP_PACKETS_PER_PASS; i++)
+    {
+        int size = _udp.parsePacket();
+        if (size <= 0)
+        {
+            return NTP_NONE;
+        }
+        uint8_t packet[NTP_PACKET_SIZE];
+        if (size < NTP_PACKET_SIZE || _udp.read(packet, sizeof(packet)) != NTP_PACKET_SIZE)
+        {
+            stats.invalid++;
+            continue;
+        }
+        // stratum 0 is a kiss-o'-death, the server wants the client to
+        // back off, which the retry after the timeout does
+        if ((packet[0] & 0x07) != NTP_MODE_SERVER ||
+            packet[0] >> 6 == NTP_LEAP_UNSYNCHRONIZED ||
+            packet[1] == 0 ||
+            _read64(packet + NTP_ORIGINATE) != _originate)
+        {
+            stats.invalid++;
+            continue;
+        }
+
+        uint64_t requested = _fromNtp(_originate);
+        uint64_t received = _fromNtp(_read64(packet + NTP_RECEIVE));
+        uint64_t transmitted = _fromNtp(_read64(packet + NTP_TRANSMIT));
+        uint64_t replied = _clock.time(now);
+        int64_t offset = ((int64_t)(received - requested) + (int64_t)(transmitted - replied)) / 2;
+        int64_t delay = (int64_t)(replied - requested) - (int64_t)(transmitted - received);
+
+        _waiting = false;
+        _timeoutsInRow = 0;
+        _due = now + NTP_INTERVAL_US;
+        stats.replies++;
+        stats.rtt = delay > 0 ? delay : 0;
+        stats.offset = offset > INT32_MAX ? INT32_MAX : offset < INT32_MIN ? INT32_MIN : offset;
+        stats.lastSync = millis();
+        return _apply(offset, now);
+    }
+    return NTP_NONE;
+}
+
+// Steps the wall clock on the first reply and on large offsets, otherwise
+// slews it. Right after a correction the clock is expected to be off by
+// what is still left to slew, anything beyond that is drift.
+uint8_t NtpClient::_apply(int64_t offset, uint32_t now)
+{
+    uint8_t result = NTP_SLEWED;
+    if (!_clock.synced() || offset > NTP_STEP_THRESHOLD_US || offset < -NTP_STEP_THRESHOLD_US)
+    {
+        _clock.sync(_clock.time(now) + offset, now);
+        stats.steps++;
+        result = NTP_STEPPED;
+    }
+    else
+    {
+        if (_sampled && now != _lastSample)
+        {
+            int64_t drift = offset - _clock.pendingSlew();
+            stats.drift = -drift * 1000000000 / (int64_t)(now - _lastSample);
+        }
+        _clock.slew(offset);
+    }
+    _lastSample = now;
+    _sampled = true;
+    return result;
+}
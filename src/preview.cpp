@@ -0,0 +1,173 @@
+#include "preview.hpp"
+
+// GRB wire order of NeoGrbFeature to the RGB of the preview
+static const uint8_t _rgbOrder[3] = {1, 0, 2};
+
+static uint8_t *_write16(uint8_t *out, uint16_t value)
+{
+    *out++ = value;
+    *out++ = value >> 8;
+    return out;
+}
+
+Preview::Preview()
+{
+}
+
+Preview::~Preview()
+{
+    for (Client &client : _clients)
+    {
+        delete[] client.shadow;
+    }
+    delete[] _message;
+}
+
+int8_t Preview::_find(uint8_t id) const
+{
+    for (uint8_t slot = 0; slot < PREVIEW_CLIENTS; slot++)
+    {
+        if (_clients[slot].connected && _clients[slot].id == id)
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Takes a free slot for a new client, returns false if all are taken
+bool Preview::connect(uint8_t id)
+{
+    for (Client &client : _clients)
+    {
+        if (!client.connected)
+        {
+            client.connected = true;
+            client.ready = true;
+            client.id = id;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Preview::disconnect(uint8_t id)
+{
+    int8_t slot = _find(id);
+    if (slot < 0)
+    {
+        return;
+    }
+    Client &client = _clients[slot];
+    delete[] client.shadow;
+    client = {};
+
+    // the message buffer is only needed while someone is watching
+    for (const Client &other : _clients)
+    {
+        if (other.connected)
+        {
+            return;
+        }
+    }
+    delete[] _message;
+    _message = nullptr;
+    _messageSize = 0;
+}
+
+void Preview::ready(uint8_t id)
+{
+    int8_t slot = _find(id);
+    if (slot >= 0)
+    {
+        _clients[slot].ready = true;
+    }
+}
+
+// The websocket client number of a slot, -1 if it is free
+int16_t Preview::client(uint8_t slot) const
+{
+    return _clients[slot].connected ? _clients[slot].id : -1;
+}
+
+// Writes the changes since the last frame sent to the client of slot into
+// message() and returns the length, 0 if there is nothing to send. New
+// clients and changed strip lengths get all pixels.
+size_t Preview::encode(uint8_t slot, const uint8_t *pixels, uint16_t count, const uint8_t *bgPixels, uint16_t bgCount)
+{
+    Client &client = _clients[slot];
+    if (!client.connected || !client.ready)
+    {
+        return 0;
+    }
+    uint16_t total = count + bgCount;
+    size_t size = (size_t)total * 3;
+    bool keyframe = client.shadow == nullptr || client.size != size;
+    if (keyframe)
+    {
+        delete[] client.shadow;
+        client.shadow = new uint8_t[size];
+        client.size = size;
+    }
+    // worst case is a keyframe split into runs of 255 pixels
+    size_t messageSize = PREVIEW_HEADER_SIZE + size + (total / 255 + 1) * PREVIEW_RUN_SIZE;
+    if (_messageSize < messageSize)
+    {
+        delete[] _message;
+        _message = new uint8_t[messageSize];
+        _messageSize = messageSize;
+    }
+
+    auto pixel = [&](uint16_t i) -> const uint8_t * {
+        return i < count ? pixels + i * 3 : bgPixels + (i - count) * 3;
+    };
+    auto unchanged = [&](uint16_t i) -> bool {
+        return !keyframe && memcmp(pixel(i), client.shadow + i * 3, 3) == 0;
+    };
+
+    uint8_t *out = _message;
+    *out++ = keyframe ? PREVIEW_KEYFRAME : 0;
+    out = _write16(out, count);
+    out = _write16(out, bgCount);
+    uint16_t i = 0;
+    while (i < total)
+    {
+        if (unchanged(i))
+        {
+            i++;
+            continue;
+        }
+        uint8_t *run = out;
+        out += PREVIEW_RUN_SIZE;
+        uint16_t start = i;
+        uint8_t length = 0;
+        while (i < total && length < 255)
+        {
+            // a single unchanged pixel is cheaper to send than a new run
+            if (unchanged(i) && (length == 254 || i + 1 == total || unchanged(i + 1)))
+            {
+                break;
+            }
+            const uint8_t *p = pixel(i);
+            for (uint8_t c : _rgbOrder)
+            {
+                *out++ = p[c];
+            }
+            memcpy(client.shadow + i * 3, p, 3);
+            i++;
+            length++;
+        }
+        run = _write16(run, start);
+        *run = length;
+    }
+
+    size_t length = out - _message;
+    if (length == PREVIEW_HEADER_SIZE && !keyframe)
+    {
+        return 0;
+    }
+    client.ready = false;
+    framesSent++;
+    bytesSent += length;
+    return length;
+}
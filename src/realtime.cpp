@@ -0,0 +1,279 @@
+#include "realtime.hpp"
+
+#define DDP_HEADER_SIZE 10
+#define DDP_TIMECODE_SIZE 4
+#define DDP_VERSION_MASK 0xC0
+#define DDP_VERSION_1 0x40
+#define DDP_FLAG_TIMECODE 0x10
+#define DDP_FLAG_REPLY 0x04
+#define DDP_FLAG_QUERY 0x02
+#define DDP_FLAG_PUSH 0x01
+#define DDP_DISPLAY 1
+
+// Offsets into an E1.31 data packet
+#define E131_IDENTIFIER 4
+#define E131_ROOT_VECTOR 18
+#define E131_FRAMING_VECTOR 40
+#define E131_SEQUENCE 111
+#define E131_OPTIONS 112
+#define E131_UNIVERSE 113
+#define E131_DMP_VECTOR 117
+#define E131_VALUE_COUNT 123
+#define E131_START_CODE 125
+#define E131_DATA 126
+#define E131_OPTION_TERMINATED 0x40
+#define E131_UNIVERSE_SIZE 510 // 170 RGB pixels
+
+// Packets read per socket and loop pass, so a flood cannot stall the loop
+#define REALTIME_PACKETS_PER_PASS 8
+
+// RGB from the sender to the GRB wire order of NeoGrbFeature
+static const uint8_t _wireOrder[3] = {1, 0, 2};
+
+static uint16_t _read16(const uint8_t *p)
+{
+    return (uint16_t)p[0] << 8 | p[1];
+}
+
+static uint32_t _read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+Realtime::Realtime()
+{
+    _release();
+}
+
+Realtime::~Realtime()
+{
+    _release();
+}
+
+// Starts listening, WiFi has to be up
+void Realtime::begin()
+{
+    _ddp.begin(REALTIME_DDP_PORT);
+    _e131.begin(REALTIME_E131_PORT);
+}
+
+// Sets the strip lengths, a running stream starts over
+void Realtime::resize(uint16_t pixelCount, uint16_t bgPixelCount)
+{
+    _release();
+    _pixelCount = pixelCount;
+    _bgPixelCount = bgPixelCount;
+    _frameSize = ((size_t)pixelCount + bgPixelCount) * 3;
+}
+
+void Realtime::_release()
+{
+    delete[] _slots;
+    _slots = nullptr;
+    _writeSlot = _readSlot = _ready = 0;
+    _receiving = _streaming = _playing = false;
+    _ddpSequence = 0;
+    for (int16_t &sequence : _e131Sequence)
+    {
+        sequence = -1;
+    }
+}
+
+// Reads the queued packets of both protocols and frees the jitter buffer
+// once no pixels came in for the timeout
+void Realtime::receive(uint32_t now)
+{
+    for (uint8_t i = 0; i < REALTIME_PACKETS_PER_PASS && _ddp.parsePacket() > 0; i++)
+    {
+        size_t length = _ddp.read(_packet, sizeof(_packet));
+        ingestDDP(_packet, length, now);
+    }
+    for (uint8_t i = 0; i < REALTIME_PACKETS_PER_PASS && _e131.parsePacket() > 0; i++)
+    {
+        size_t length = _e131.read(_packet, sizeof(_packet));
+        ingestE131(_packet, length, now);
+    }
+    if (_slots != nullptr && now - _lastPacket >= REALTIME_TIMEOUT_MS)
+    {
+        _release();
+    }
+}
+
+bool Realtime::ingestDDP(const uint8_t *packet, size_t length, uint32_t now)
+{
+    if (length < DDP_HEADER_SIZE || (packet[0] & DDP_VERSION_MASK) != DDP_VERSION_1)
+    {
+        stats.invalid++;
+        return false;
+    }
+    uint8_t flags = packet[0];
+    if (flags & (DDP_FLAG_QUERY | DDP_FLAG_REPLY) || packet[3] != DDP_DISPLAY)
+    {
+        return false;
+    }
+    size_t header = DDP_HEADER_SIZE + (flags & DDP_FLAG_TIMECODE ? DDP_TIMECODE_SIZE : 0);
+    size_t dataLength = _read16(packet + 8);
+    if (header + dataLength > length)
+    {
+        stats.invalid++;
+        return false;
+    }
+
+    // sequence numbers run from 1 to 15, 0 means the sender does not count
+    uint8_t sequence = packet[1] & 0x0F;
+    if (sequence != 0 && _ddpSequence != 0)
+    {
+        uint8_t ahead = (sequence + 15 - _ddpSequence) % 15;
+        if (ahead == 0 || ahead >= 8)
+        {
+            stats.late++;
+            return false;
+        }
+    }
+    _ddpSequence = sequence;
+    _lastPacket = now;
+
+    _writePixels(_read32(packet + 4), packet + header, dataLength);
+    if (flags & DDP_FLAG_PUSH)
+    {
+        _completeFrame(now);
+    }
+    return true;
+}
+
+bool Realtime::ingestE131(const uint8_t *packet, size_t length, uint32_t now)
+{
+    static const uint8_t identifier[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+    if (length < E131_DATA ||
+        memcmp(packet + E131_IDENTIFIER, identifier, sizeof(identifier)) != 0 ||
+        _read32(packet + E131_ROOT_VECTOR) != 4 ||
+        _read32(packet + E131_FRAMING_VECTOR) != 2 ||
+        packet[E131_DMP_VECTOR] != 2)
+    {
+        stats.invalid++;
+        return false;
+    }
+    uint16_t universe = _read16(packet + E131_UNIVERSE) - REALTIME_E131_UNIVERSE;
+    if (universe >= REALTIME_E131_UNIVERSES || packet[E131_START_CODE] != 0)
+    {
+        return false;
+    }
+    if (packet[E131_OPTIONS] & E131_OPTION_TERMINATED)
+    {
+        _release();
+        return true;
+    }
+    size_t count = _read16(packet + E131_VALUE_COUNT);
+    if (count == 0 || E131_DATA + count - 1 > length)
+    {
+        stats.invalid++;
+        return false;
+    }
+
+    // E1.31 discards packets up to 20 sequence numbers behind the last
+    uint8_t sequence = packet[E131_SEQUENCE];
+    if (_e131Sequence[universe] >= 0)
+    {
+        int8_t ahead = (int8_t)(sequence - _e131Sequence[universe]);
+        if (ahead <= 0 && ahead > -20)
+        {
+            stats.late++;
+            return false;
+        }
+    }
+    _e131Sequence[universe] = sequence;
+    _lastPacket = now;
+
+    _writePixels((size_t)universe * E131_UNIVERSE_SIZE, packet + E131_DATA, min<size_t>(count - 1, E131_UNIVERSE_SIZE));
+    // the frame is complete with the universe holding its last pixel
+    size_t lastUniverse = _frameSize > 0 ? (_frameSize - 1) / E131_UNIVERSE_SIZE : 0;
+    if (universe == min<size_t>(lastUniverse, REALTIME_E131_UNIVERSES - 1))
+    {
+        _completeFrame(now);
+    }
+    return true;
+}
+
+// Copies RGB data at a byte offset into the frame being received
+void Realtime::_writePixels(size_t offset, const uint8_t *data, size_t length)
+{
+    if (_frameSize == 0 || offset >= _frameSize)
+    {
+        return;
+    }
+    if (_slots == nullptr)
+    {
+        _slots = new uint8_t[REALTIME_SLOTS * _frameSize]();
+    }
+    length = min(length, _frameSize - offset);
+    uint8_t *pixel = _slots + _writeSlot * _frameSize + offset / 3 * 3;
+    uint8_t channel = offset % 3;
+    for (size_t i = 0; i < length; i++)
+    {
+        pixel[_wireOrder[channel]] = data[i];
+        if (++channel == 3)
+        {
+            channel = 0;
+            pixel += 3;
+        }
+    }
+    _receiving = true;
+}
+
+void Realtime::_completeFrame(uint32_t now)
+{
+    if (!_receiving)
+    {
+        return;
+    }
+    _receiving = false;
+    _streaming = true;
+    _lastFrame = now;
+    stats.received++;
+    _writeSlot = (_writeSlot + 1) % REALTIME_SLOTS;
+    if (++_ready == REALTIME_SLOTS)
+    {
+        // the next frame would overwrite the oldest one
+        _readSlot = (_readSlot + 1) % REALTIME_SLOTS;
+        _ready--;
+        stats.dropped++;
+    }
+}
+
+bool Realtime::active(uint32_t now) const
+{
+    return _streaming && now - _lastFrame < REALTIME_TIMEOUT_MS;
+}
+
+// Copies the next buffered frame into the strip buffers on a frame tick.
+// Returns false if no stream is running. After running dry the buffer
+// fills up to REALTIME_PREBUFFER frames again, the strips keep showing
+// the last frame meanwhile.
+bool Realtime::present(uint8_t *pixels, uint8_t *bgPixels, uint32_t now)
+{
+    if (!active(now))
+    {
+        return false;
+    }
+    if (!_playing)
+    {
+        if (_ready < REALTIME_PREBUFFER)
+        {
+            return true;
+        }
+        _playing = true;
+    }
+    if (_ready == 0)
+    {
+        stats.underruns++;
+        _playing = false;
+        return true;
+    }
+    const uint8_t *frame = _slots + _readSlot * _frameSize;
+    memcpy(pixels, frame, (size_t)_pixelCount * 3);
+    memcpy(bgPixels, frame + (size_t)_pixelCount * 3, (size_t)_bgPixelCount * 3);
+    _readSlot = (_readSlot + 1) % REALTIME_SLOTS;
+    _ready--;
+    stats.shown++;
+    return true;
+}
@@ -0,0 +1,78 @@
+#include "resolver.hpp"
+
+// Starts looking up host, a lookup still running is answered first and
+// its result dropped
+void Resolver::begin(const char *host, uint32_t now)
+{
+    strlcpy(_host, host, sizeof(_host));
+    _state = RESOLVE_PENDING;
+    _started = now;
+    if (_inFlight)
+    {
+        _restart = true;
+        return;
+    }
+    _start();
+}
+
+// Returns RESOLVE_DONE once address() holds the address of the host
+uint8_t Resolver::poll(uint32_t now)
+{
+    if (_state != RESOLVE_PENDING)
+    {
+        return _state;
+    }
+    if (_inFlight)
+    {
+        // lwIP gives up by itself, but only after several retries
+        if (now - _started >= RESOLVER_TIMEOUT_MS)
+        {
+            _state = RESOLVE_FAILED;
+        }
+        return _state;
+    }
+    if (_restart)
+    {
+        _restart = false;
+        _start();
+        return _state;
+    }
+    _state = _address != 0 ? RESOLVE_DONE : RESOLVE_FAILED;
+    return _state;
+}
+
+#ifdef NATIVE_BUILD
+void Resolver::_start()
+{
+    IPAddress address;
+    _address = address.fromString(_host) ? (uint32_t)address : 0;
+    _state = _address != 0 ? RESOLVE_DONE : RESOLVE_FAILED;
+}
+#else
+// Called by lwIP with the address, or with nullptr if there is none. On
+// ESP32 this runs in the task of the TCP/IP stack.
+void Resolver::_found(const char *name, const ip_addr_t *address, void *arg)
+{
+    Resolver *resolver = static_cast<Resolver *>(arg);
+    resolver->_address = address != nullptr ? ip4_addr_get_u32(ip_2_ip4(address)) : 0;
+    resolver->_inFlight = false;
+}
+
+void Resolver::_start()
+{
+    ip_addr_t address;
+    _address = 0;
+    _inFlight = true;
+    err_t err = dns_gethostbyname(_host, &address, &Resolver::_found, this);
+    if (err == ERR_INPROGRESS)
+    {
+        return;
+    }
+    _inFlight = false;
+    if (err == ERR_OK)
+    {
+        _address = ip4_addr_get_u32(ip_2_ip4(&address));
+    }
+    _state = _address != 0 ? RESOLVE_DONE : RESOLVE_FAILED;
+}
+#endif
@@ -0,0 +1,146 @@
+#include "scheduler.hpp"
+
+#define SECONDS_PER_DAY 86400UL
+#define SECONDS_PER_WEEK (7 * SECONDS_PER_DAY)
+
+// Sets the function that tells the offset of the local time zone at a
+// time, without one the clock runs on UTC
+void Scheduler::setZone(ZoneOffset zoneOffset)
+{
+    _zoneOffset = zoneOffset;
+}
+
+void Scheduler::on(ScheduleEvent event, std::function<void()> handler)
+{
+    _handlers[event] = handler;
+}
+
+void Scheduler::plan(const ConfigData &config, uint32_t utc)
+{
+    // the night ends after the minute it is set to
+    _nightStart = config.nightTimeBegins * 60UL % SECONDS_PER_DAY;
+    _nightEnd = (config.nightTimeEnds + 1) * 60UL % SECONDS_PER_DAY;
+    _alarmActive = config.alarmActive;
+    _alarmStart = config.alarmTime * 60UL % SECONDS_PER_DAY;
+
+    _planZone(utc);
+    _planWindows(utc);
+    for (std::function<void()> &handler : _handlers)
+    {
+        if (handler)
+        {
+            handler();
+        }
+    }
+}
+
+// Calls the handlers of the events that are due, and of those whose
+// state changed because the offset did
+void Scheduler::_fire(uint32_t utc)
+{
+    bool due[EVENT_COUNT];
+    for (uint8_t i = 0; i < EVENT_COUNT; i++)
+    {
+        due[i] = utc >= _next[i];
+    }
+    bool night = _night;
+    bool alarm = _alarm;
+    if (due[EVENT_DST])
+    {
+        _planZone(utc);
+    }
+    _planWindows(utc);
+    due[EVENT_NIGHT] |= night != _night;
+    due[EVENT_ALARM] |= alarm != _alarm;
+
+    for (uint8_t i = 0; i < EVENT_COUNT; i++)
+    {
+        if (due[i] && _handlers[i])
+        {
+            _handlers[i]();
+        }
+    }
+}
+
+// Takes the current offset and looks for its next change week by week,
+// then narrows it down to the second. Without a change ahead the offset
+// is checked again when the search range ends.
+void Scheduler::_planZone(uint32_t utc)
+{
+    if (_zoneOffset == nullptr)
+    {
+        _offset = 0;
+        _next[EVENT_DST] = SCHEDULE_NEVER;
+        return;
+    }
+    _offset = _zoneOffset(utc);
+    _next[EVENT_DST] = utc + SCHEDULE_SEARCH_WEEKS * SECONDS_PER_WEEK;
+    for (uint32_t week = 1; week <= SCHEDULE_SEARCH_WEEKS; week++)
+    {
+        uint32_t changed = utc + week * SECONDS_PER_WEEK;
+        if (_zoneOffset(changed) == _offset)
+        {
+            continue;
+        }
+        uint32_t unchanged = changed - SECONDS_PER_WEEK;
+        while (changed - unchanged > 1)
+        {
+            uint32_t middle = unchanged + (changed - unchanged) / 2;
+            if (_zoneOffset(middle) == _offset)
+            {
+                unchanged = middle;
+            }
+            else
+            {
+                changed = middle;
+            }
+        }
+        _next[EVENT_DST] = changed;
+        break;
+    }
+}
+
+// Computes the night and alarm state and their next changes at the
+// current offset. A change of the offset before them plans them again.
+void Scheduler::_planWindows(uint32_t utc)
+{
+    uint32_t local = utc + _offset;
+    uint32_t night = _nextChange(local, _nightStart, _nightEnd, _night);
+    uint32_t alarm = SCHEDULE_NEVER;
+    _alarm = false;
+    if (_alarmActive)
+    {
+        alarm = _nextChange(local, _alarmStart, (_alarmStart + 60) % SECONDS_PER_DAY, _alarm);
+    }
+    _next[EVENT_NIGHT] = night == SCHEDULE_NEVER ? night : night - _offset;
+    _next[EVENT_ALARM] = alarm == SCHEDULE_NEVER ? alarm : alarm - _offset;
+
+    _due = SCHEDULE_NEVER;
+    for (uint32_t next : _next)
+    {
+        _due = min(_due, next);
+    }
+}
+
+// Local time the daily window from start to end next begins or ends, and
+// whether local is inside of it. A window that ends where it starts lasts
+// all day.
+uint32_t Scheduler::_nextChange(uint32_t local, uint32_t start, uint32_t end, bool &inside)
+{
+    uint32_t time = local % SECONDS_PER_DAY;
+    if (start == end)
+    {
+        inside = true;
+        return SCHEDULE_NEVER;
+    }
+    if (start < end)
+    {
+        inside = start <= time && time < end;
+    }
+    else
+    {
+        inside = time >= start || time < end;
+    }
+    uint32_t change = inside ? end : start;
+    return local + (change + SECONDS_PER_DAY - time) % SECONDS_PER_DAY;
+}
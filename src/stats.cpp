@@ -0,0 +1,174 @@
+#include "stats.hpp"
+
+const uint32_t Stats::bucketBounds[HISTOGRAM_BUCKETS - 1] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 16666, 50000, 100000};
+
+const char *Stats::stageNames[STAGE_COUNT] = {
+    "webserver", "config", "rollover", "render", "show", "mqtt", "mdns", "events", "realtime"};
+
+Stats::Stats()
+{
+}
+
+// Records the time since start for the stage and returns the current
+// time, so consecutive stages can be chained.
+uint32_t Stats::record(LoopStage stage, uint32_t start)
+{
+        uint32_t now = micros();
+        uint32_t duration = now - start;
+        Histogram &histogram = stages[stage];
+
+        uint8_t bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 && duration > bucketBounds[bucket])
+        {
+                bucket++;
+        }
+        histogram.buckets[bucket]++;
+        histogram.count++;
+        histogram.sum += duration;
+        if (duration > histogram.max)
+        {
+                histogram.max = duration;
+        }
+        return now;
+}
+
+void Stats::reset()
+{
+        memset(stages, 0, sizeof(stages));
+}
+
+void Stats::toJSON(JsonDocument &doc)
+{
+        JsonArray bounds = doc.createNestedArray("bounds");
+        for (uint32_t bound : bucketBounds)
+        {
+                bounds.add(bound);
+        }
+
+        JsonObject stageObj = doc.createNestedObject("stages");
+        for (uint8_t i = 0; i < STAGE_COUNT; i++)
+        {
+                JsonObject obj = stageObj.createNestedObject(stageNames[i]);
+                obj["count"] = stages[i].count;
+                obj["mean"] = stages[i].count ? (uint32_t)(stages[i].sum / stages[i].count) : 0;
+                obj["max"] = stages[i].max;
+                JsonArray buckets = obj.createNestedArray("buckets");
+                for (uint32_t count : stages[i].buckets)
+                {
+                        buckets.add(count);
+                }
+        }
+}
+
+// Writes "# TYPE name type" and the sample of a metric without labels.
+// The metrics are written with print() only, printf() allocates a buffer
+// on the heap for every line longer than 64 bytes.
+void Stats::writeMetric(Print &out, const __FlashStringHelper *name, const __FlashStringHelper *type, uint32_t value)
+{
+        out.print(F("# TYPE "));
+        out.print(name);
+        out.print(' ');
+        out.print(type);
+        out.print('\n');
+        out.print(name);
+        out.print(' ');
+        out.print(value);
+        out.print('\n');
+}
+
+// Writes µs as seconds with six decimals
+void Stats::writeSeconds(Print &out, uint64_t us)
+{
+        uint32_t fraction = us % 1000000;
+        out.print((uint32_t)(us / 1000000));
+        out.print('.');
+        for (uint32_t digit = 100000; digit > 0; digit /= 10)
+        {
+                out.print((char)('0' + fraction / digit % 10));
+        }
+}
+
+// Starts a sample of the stage histogram, up to the value of its stage
+// label
+static void _beginStage(Print &out, const __FlashStringHelper *suffix, const char *stage)
+{
+        out.print(F("espclock_loop_stage_seconds"));
+        out.print(suffix);
+        out.print(F("{stage=\""));
+        out.print(stage);
+}
+
+// Writes the frame counters and the stage histograms in the Prometheus
+// text format, with cumulative buckets and durations in seconds.
+void Stats::toPrometheus(Print &out)
+{
+        if (frames != nullptr)
+        {
+                writeMetric(out, F("espclock_frames_rendered_total"), F("counter"), frames->rendered);
+                writeMetric(out, F("espclock_frames_late_total"), F("counter"), frames->late);
+                writeMetric(out, F("espclock_frames_dropped_total"), F("counter"), frames->dropped);
+        }
+
+        if (realtime != nullptr)
+        {
+                writeMetric(out, F("espclock_realtime_frames_received_total"), F("counter"), realtime->received);
+                writeMetric(out, F("espclock_realtime_frames_shown_total"), F("counter"), realtime->shown);
+                writeMetric(out, F("espclock_realtime_frames_dropped_total"), F("counter"), realtime->dropped);
+                writeMetric(out, F("espclock_realtime_packets_late_total"), F("counter"), realtime->late);
+                writeMetric(out, F("espclock_realtime_packets_invalid_total"), F("counter"), realtime->invalid);
+                writeMetric(out, F("espclock_realtime_underruns_total"), F("counter"), realtime->underruns);
+        }
+
+        if (ntp != nullptr)
+        {
+                writeMetric(out, F("espclock_ntp_requests_total"), F("counter"), ntp->requests);
+                writeMetric(out, F("espclock_ntp_replies_total"), F("counter"), ntp->replies);
+                writeMetric(out, F("espclock_ntp_timeouts_total"), F("counter"), ntp->timeouts);
+                writeMetric(out, F("espclock_ntp_replies_invalid_total"), F("counter"), ntp->invalid);
+                writeMetric(out, F("espclock_ntp_steps_total"), F("counter"), ntp->steps);
+        }
+        if (ntp != nullptr && ntp->replies > 0)
+        {
+                writeMetric(out, F("espclock_ntp_sync_age_seconds"), F("gauge"), (millis() - ntp->lastSync) / 1000);
+                out.print(F("# TYPE espclock_ntp_offset_seconds gauge\nespclock_ntp_offset_seconds "));
+                if (ntp->offset < 0)
+                {
+                        out.print('-');
+                }
+                writeSeconds(out, ntp->offset < 0 ? -(int64_t)ntp->offset : ntp->offset);
+                out.print(F("\n# TYPE espclock_ntp_rtt_seconds gauge\nespclock_ntp_rtt_seconds "));
+                writeSeconds(out, ntp->rtt);
+                out.print(F("\n# TYPE espclock_ntp_drift_ppb gauge\nespclock_ntp_drift_ppb "));
+                out.print(ntp->drift);
+                out.print('\n');
+        }
+
+        out.print(F("# TYPE espclock_loop_stage_seconds histogram\n"));
+        for (uint8_t i = 0; i < STAGE_COUNT; i++)
+        {
+                uint32_t cumulative = 0;
+                for (uint8_t b = 0; b < HISTOGRAM_BUCKETS - 1; b++)
+                {
+                        cumulative += stages[i].buckets[b];
+                        _beginStage(out, F("_bucket"), stageNames[i]);
+                        out.print(F("\",le=\""));
+                        writeSeconds(out, bucketBounds[b]);
+                        out.print(F("\"} "));
+                        out.print(cumulative);
+                        out.print('\n');
+                }
+                _beginStage(out, F("_bucket"), stageNames[i]);
+                out.print(F("\",le=\"+Inf\"} "));
+                out.print(stages[i].count);
+                out.print('\n');
+                _beginStage(out, F("_sum"), stageNames[i]);
+                out.print(F("\"} "));
+                writeSeconds(out, stages[i].sum);
+                out.print('\n');
+                _beginStage(out, F("_count"), stageNames[i]);
+                out.print(F("\"} "));
+                out.print(stages[i].count);
+                out.print('\n');
+        }
+}
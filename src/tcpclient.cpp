@@ -0,0 +1,364 @@
+#include "tcpclient.hpp"
+
+size_t TcpClient::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+// Takes a whole packet or none of it. What the stack does not take right
+// away waits in the buffer, behind anything still waiting there.
+size_t TcpClient::write(const uint8_t *buffer, size_t size)
+{
+    flush();
+    if (status() != TCP_OPEN)
+    {
+        return 0;
+    }
+    size_t room = _txLength == 0 ? _room() : 0;
+    if (size > room && size - room > TCP_TX_BUFFER - _txLength)
+    {
+        return 0;
+    }
+    size_t sent = _txLength == 0 ? _send(buffer, size) : 0;
+    if (size - sent > TCP_TX_BUFFER - _txLength)
+    {
+        // sockets cannot tell their room in advance, a packet that got
+        // cut anyway ends the connection instead of the stream
+        close();
+        _status = TCP_FAILED;
+        return 0;
+    }
+    memcpy(_tx + _txLength, buffer + sent, size - sent);
+    _txLength += size - sent;
+    return size;
+}
+
+// Hands as much of the buffered data to the stack as it takes right now
+void TcpClient::flush()
+{
+    if (_txLength == 0 || status() != TCP_OPEN)
+    {
+        return;
+    }
+    size_t sent = _send(_tx, _txLength);
+    memmove(_tx, _tx + sent, _txLength - sent);
+    _txLength -= sent;
+}
+
+int TcpClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+// Data the peer sent before closing can still be read, available() also
+// notices the close
+uint8_t TcpClient::connected()
+{
+    return available() > 0 || status() == TCP_OPEN;
+}
+
+#if defined(ESP8266)
+// Starts connecting to ip, false if the stack could not even try
+bool TcpClient::open(IPAddress ip, uint16_t port)
+{
+    close();
+    _pcb = tcp_new();
+    if (_pcb == nullptr)
+    {
+        _status = TCP_FAILED;
+        return false;
+    }
+    tcp_arg(_pcb, this);
+    tcp_err(_pcb, &TcpClient::_error);
+    tcp_recv(_pcb, &TcpClient::_received);
+    tcp_nagle_disable(_pcb);
+    ip_addr_t address;
+    ip_addr_set_ip4_u32(&address, (uint32_t)ip);
+    if (tcp_connect(_pcb, &address, port, &TcpClient::_connected) != ERR_OK)
+    {
+        tcp_abort(_pcb);
+        _pcb = nullptr;
+        _status = TCP_FAILED;
+        return false;
+    }
+    _status = TCP_CONNECTING;
+    return true;
+}
+
+err_t TcpClient::_connected(void *arg, tcp_pcb *pcb, err_t err)
+{
+    static_cast<TcpClient *>(arg)->_status = TCP_OPEN;
+    return ERR_OK;
+}
+
+// Queues received data until read() takes it, no data means the peer
+// closed the connection
+err_t TcpClient::_received(void *arg, tcp_pcb *pcb, pbuf *p, err_t err)
+{
+    TcpClient *client = static_cast<TcpClient *>(arg);
+    if (p == nullptr)
+    {
+        client->_status = TCP_FAILED;
+    }
+    else if (client->_rx == nullptr)
+    {
+        client->_rx = p;
+    }
+    else
+    {
+        pbuf_cat(client->_rx, p);
+    }
+    return ERR_OK;
+}
+
+// lwIP already freed the connection when it reports an error
+void TcpClient::_error(void *arg, err_t err)
+{
+    TcpClient *client = static_cast<TcpClient *>(arg);
+    client->_pcb = nullptr;
+    client->_status = TCP_FAILED;
+}
+
+uint8_t TcpClient::status()
+{
+    return _status;
+}
+
+size_t TcpClient::_room()
+{
+    return _pcb != nullptr ? tcp_sndbuf(_pcb) : 0;
+}
+
+size_t TcpClient::_send(const uint8_t *data, size_t size)
+{
+    if (_status != TCP_OPEN || _pcb == nullptr)
+    {
+        return 0;
+    }
+    size_t length = min(size, _room());
+    if (length == 0 || tcp_write(_pcb, data, length, TCP_WRITE_FLAG_COPY) != ERR_OK)
+    {
+        return 0;
+    }
+    tcp_output(_pcb);
+    return length;
+}
+
+// PubSubClient waits for the CONNACK by calling this in a loop, the
+// yield lets lwIP deliver it like the available() of WiFiClient does
+int TcpClient::available()
+{
+    if (_rx == nullptr)
+    {
+        optimistic_yield(100);
+        return 0;
+    }
+    return _rx->tot_len - _rxOffset;
+}
+
+int TcpClient::read(uint8_t *buffer, size_t size)
+{
+    size_t count = 0;
+    while (_rx != nullptr && count < size)
+    {
+        size_t length = min(size - count, (size_t)(_rx->len - _rxOffset));
+        memcpy(buffer + count, static_cast<uint8_t *>(_rx->payload) + _rxOffset, length);
+        count += length;
+        _rxOffset += length;
+        if (_rxOffset == _rx->len)
+        {
+            // keep the rest of the chain when freeing its first pbuf
+            pbuf *head = _rx;
+            _rx = head->next;
+            if (_rx != nullptr)
+            {
+                pbuf_ref(_rx);
+            }
+            pbuf_free(head);
+            _rxOffset = 0;
+        }
+    }
+    if (count > 0 && _pcb != nullptr)
+    {
+        tcp_recved(_pcb, count);
+    }
+    return count;
+}
+
+int TcpClient::peek()
+{
+    return _rx != nullptr ? static_cast<uint8_t *>(_rx->payload)[_rxOffset] : -1;
+}
+
+void TcpClient::close()
+{
+    if (_pcb != nullptr)
+    {
+        tcp_arg(_pcb, nullptr);
+        tcp_err(_pcb, nullptr);
+        tcp_recv(_pcb, nullptr);
+        if (tcp_close(_pcb) != ERR_OK)
+        {
+            tcp_abort(_pcb);
+        }
+        _pcb = nullptr;
+    }
+    if (_rx != nullptr)
+    {
+        pbuf_free(_rx);
+        _rx = nullptr;
+    }
+    _rxOffset = 0;
+    _txLength = 0;
+    _status = TCP_CLOSED;
+}
+
+#else
+#if defined(ESP32)
+#include <lwip/sockets.h>
+#include <unistd.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Starts connecting to ip, false if the stack could not even try
+bool TcpClient::open(IPAddress ip, uint16_t port)
+{
+    close();
+    _socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (_socket < 0)
+    {
+        _status = TCP_FAILED;
+        return false;
+    }
+    fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL, 0) | O_NONBLOCK);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = (uint32_t)ip;
+    address.sin_port = htons(port);
+    if (::connect(_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+    {
+        _status = TCP_OPEN;
+    }
+    else if (errno == EINPROGRESS)
+    {
+        _status = TCP_CONNECTING;
+    }
+    else
+    {
+        close();
+        _status = TCP_FAILED;
+        return false;
+    }
+    return true;
+}
+
+// Looks without waiting whether a pending connect got through
+uint8_t TcpClient::status()
+{
+    if (_status != TCP_CONNECTING)
+    {
+        return _status;
+    }
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(_socket, &writable);
+    timeval now = {0, 0};
+    int ready = select(_socket + 1, nullptr, &writable, nullptr, &now);
+    if (ready > 0)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(_socket, SOL_SOCKET, SO_ERROR, &error, &length);
+        _status = error == 0 ? TCP_OPEN : TCP_FAILED;
+    }
+    else if (ready < 0)
+    {
+        _status = TCP_FAILED;
+    }
+    return _status;
+}
+
+// A socket only tells how much it takes by taking it
+size_t TcpClient::_room()
+{
+    return SIZE_MAX;
+}
+
+size_t TcpClient::_send(const uint8_t *data, size_t size)
+{
+    if (_status != TCP_OPEN)
+    {
+        return 0;
+    }
+    ssize_t sent = ::send(_socket, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            _status = TCP_FAILED;
+        }
+        return 0;
+    }
+    return sent;
+}
+
+// Refills the receive buffer once it is empty
+int TcpClient::available()
+{
+    if (_rxStart == _rxEnd && _status == TCP_OPEN)
+    {
+        ssize_t received = recv(_socket, _rx, sizeof(_rx), MSG_DONTWAIT);
+        if (received > 0)
+        {
+            _rxStart = 0;
+            _rxEnd = received;
+        }
+        else if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            _status = TCP_FAILED;
+        }
+    }
+    return _rxEnd - _rxStart;
+}
+
+int TcpClient::read(uint8_t *buffer, size_t size)
+{
+    size_t count = 0;
+    while (count < size && available() > 0)
+    {
+        size_t length = min(size - count, _rxEnd - _rxStart);
+        memcpy(buffer + count, _rx + _rxStart, length);
+        count += length;
+        _rxStart += length;
+    }
+    return count;
+}
+
+int TcpClient::peek()
+{
+    return available() > 0 ? _rx[_rxStart] : -1;
+}
+
+void TcpClient::close()
+{
+    if (_socket >= 0)
+    {
+        ::close(_socket);
+        _socket = -1;
+    }
+    _rxStart = _rxEnd = 0;
+    _txLength = 0;
+    _status = TCP_CLOSED;
+}
+#endif
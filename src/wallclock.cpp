@@ -0,0 +1,106 @@
+#include "wallclock.hpp"
+
+#define SECONDS_PER_DAY 86400UL
+
+// Sets the time to time µs since 1970 at micros() now. A resync that
+// moves the time over a boundary gets reported by the next update() like
+// a regular one.
+void WallClock::sync(uint64_t time, uint32_t now)
+{
+    _utc = time / 1000000;
+    _secondStart = now - (uint32_t)(time % 1000000);
+    _slew = 0;
+    _synced = true;
+}
+
+// Corrects the time by offset µs, spread over the following seconds
+void WallClock::slew(int32_t offset)
+{
+    _slew = offset;
+}
+
+// Seconds local time is ahead of UTC, including daylight saving time
+void WallClock::setOffset(int32_t offset)
+{
+    _offset = offset;
+}
+
+// Advances the time to micros() now and returns the boundaries crossed
+// since the last call, or all of them on the first call after a sync
+uint8_t WallClock::update(uint32_t now)
+{
+    if (!_synced)
+    {
+        return 0;
+    }
+    uint32_t elapsed = now - _secondStart;
+    if (elapsed >= 1000000)
+    {
+        uint32_t seconds = elapsed / 1000000;
+        _utc += seconds;
+        _secondStart += seconds * 1000000;
+
+        // a correction back in time may not go back before the second began
+        int32_t limit = WALLCLOCK_SLEW_RATE * min(seconds, (uint32_t)1000);
+        int32_t back = min(limit, (int32_t)(now - _secondStart));
+        int32_t step = _slew > limit ? limit : _slew < -back ? -back : _slew;
+        _secondStart -= step;
+        _slew -= step;
+    }
+
+    uint32_t local = _utc + _offset;
+    if (_started && local == _shown)
+    {
+        return 0;
+    }
+    uint8_t boundaries = CLOCK_SECOND;
+    if (!_started || local / 60 != _shown / 60)
+    {
+        boundaries |= CLOCK_MINUTE;
+    }
+    if (!_started || local / 3600 != _shown / 3600)
+    {
+        boundaries |= CLOCK_HOUR;
+    }
+    if (!_started || local / SECONDS_PER_DAY != _shown / SECONDS_PER_DAY)
+    {
+        boundaries |= CLOCK_DAY;
+    }
+    _started = true;
+    _shown = local;
+    _split(local);
+    return boundaries;
+}
+
+// µs since 1970 at micros() now
+uint64_t WallClock::time(uint32_t now) const
+{
+    return (uint64_t)_utc * 1000000 + (now - _secondStart);
+}
+
+// Milliseconds since the current second began
+uint16_t WallClock::ms(uint32_t now) const
+{
+    return (now - _secondStart) % 1000000 / 1000;
+}
+
+// Breaks local time down into its fields, the date after Howard Hinnant's
+// civil_from_days()
+void WallClock::_split(uint32_t local)
+{
+    uint32_t days = local / SECONDS_PER_DAY;
+    uint32_t seconds = local % SECONDS_PER_DAY;
+    _hour = seconds / 3600;
+    _minute = seconds / 60 % 60;
+    _second = seconds % 60;
+    _weekday = (days + 3) % 7 + 1;
+
+    uint32_t z = days + 719468;
+    uint32_t era = z / 146097;
+    uint32_t dayOfEra = z - era * 146097;
+    uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    uint32_t monthIndex = (5 * dayOfYear + 2) / 153; // March is 0
+    _day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    _month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+}
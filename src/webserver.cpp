@@ -10,40 +10,207 @@ ESP8266HTTPUpdateServer _httpUpdater;
 #elif defined(ESP32)
 WebServer _server(80);
 #endif
+WebSocketsServer _previewServer(PREVIEW_PORT);
 
 Webserver::Webserver()
 {
 }
 
+// Sends a response in HTTP chunks as the buffer of ChunkedPrint fills up
+class ChunkedResponse : public ChunkedPrint
+{
+public:
+  ChunkedResponse(int code, const char *contentType)
+  {
+    _server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    _server.send(code, contentType, "");
+  }
+
+  ~ChunkedResponse()
+  {
+    flush();
+    _server.sendContent("");
+  }
+
+protected:
+  void sendChunk(const char *data, size_t length) override
+  {
+    _server.sendContent(data, length);
+  }
+};
+
+// Registers a route and counts the requests it serves
+void Webserver::_on(const char *uri, HTTPMethod method, std::function<void()> handler)
+{
+  if (_routeCount == MAX_ROUTES)
+  {
+    _server.on(uri, method, handler);
+    return;
+  }
+  Route &route = _routes[_routeCount++];
+  route.uri = uri;
+  route.method = method;
+  _server.on(uri, method, [&route, handler]()
+             { route.requests++; handler(); });
+}
+
+static const char *_methodName(HTTPMethod method)
+{
+  switch (method)
+  {
+  case HTTP_POST:
+    return "POST";
+  case HTTP_PATCH:
+    return "PATCH";
+  default:
+    return "GET";
+  }
+}
+
+void Webserver::_handleMetrics(Config &config, Stats &stats, Mqtt &mqtt)
+{
+  ChunkedResponse out(200, "text/plain; version=0.0.4");
+
+  uint32_t freeHeap = ESP.getFreeHeap();
+#if defined(ESP8266)
+  uint32_t fragmentation = ESP.getHeapFragmentation();
+  uint32_t maxFreeBlock = ESP.getMaxFreeBlockSize();
+#elif defined(ESP32)
+  uint32_t maxFreeBlock = ESP.getMaxAllocHeap();
+  uint32_t fragmentation = freeHeap ? 100 - maxFreeBlock * 100 / freeHeap : 0;
+#endif
+  Stats::writeMetric(out, F("espclock_heap_free_bytes"), F("gauge"), freeHeap);
+  Stats::writeMetric(out, F("espclock_heap_fragmentation_percent"), F("gauge"), fragmentation);
+  Stats::writeMetric(out, F("espclock_heap_max_free_block_bytes"), F("gauge"), maxFreeBlock);
+  // millis() wraps after 49 days, so the uptime is no counter
+  Stats::writeMetric(out, F("espclock_uptime_seconds"), F("gauge"), millis() / 1000);
+
+  stats.toPrometheus(out);
+
+  Stats::writeMetric(out, F("espclock_mqtt_connected"), F("gauge"), mqtt.connected());
+  Stats::writeMetric(out, F("espclock_mqtt_connects_total"), F("counter"), mqtt.connectCount);
+  Stats::writeMetric(out, F("espclock_mqtt_connect_attempts_total"), F("counter"), mqtt.connectAttempts);
+  Stats::writeMetric(out, F("espclock_mqtt_connect_failures_total"), F("counter"), mqtt.connectFailures);
+  if (mqtt.connectCount > 0)
+  {
+    Stats::writeMetric(out, F("espclock_mqtt_last_connect_age_seconds"), F("gauge"), (millis() - mqtt.lastConnect) / 1000);
+  }
+  Stats::writeMetric(out, F("espclock_preview_frames_total"), F("counter"), _preview.framesSent);
+  Stats::writeMetric(out, F("espclock_preview_bytes_total"), F("counter"), _preview.bytesSent);
+  Stats::writeMetric(out, F("espclock_config_saves_total"), F("counter"), config.saveCount);
+  Stats::writeMetric(out, F("espclock_config_flash_writes_total"), F("counter"), config.writeCount);
+  Stats::writeMetric(out, F("espclock_config_save_pending"), F("gauge"), config.savePending);
+  out.print(F("# TYPE espclock_config_last_save_seconds gauge\nespclock_config_last_save_seconds "));
+  Stats::writeSeconds(out, config.lastSaveDuration);
+  out.print('\n');
+
+  out.print(F("# TYPE espclock_http_requests_total counter\n"));
+  for (uint8_t i = 0; i < _routeCount; i++)
+  {
+    out.print(F("espclock_http_requests_total{path=\""));
+    out.print(_routes[i].uri);
+    out.print(F("\",method=\""));
+    out.print(_methodName(_routes[i].method));
+    out.print(F("\"} "));
+    out.print(_routes[i].requests);
+    out.print('\n');
+  }
+  // requests no route matched, whatever their path and method
+  out.print(F("espclock_http_requests_total{path=\"unmatched\",method=\"any\"} "));
+  out.print(_notFoundRequests);
+  out.print('\n');
+}
+
 void Webserver::handleRequest()
 {
   _server.handleClient();
+  _previewServer.loop();
+}
+
+void Webserver::_handlePreviewEvent(uint8_t client, WStype_t type)
+{
+  switch (type)
+  {
+  case WStype_CONNECTED:
+    if (!_preview.connect(client))
+    {
+      _previewServer.disconnect(client);
+    }
+    break;
+  case WStype_DISCONNECTED:
+    _preview.disconnect(client);
+    break;
+  case WStype_TEXT:
+  case WStype_BIN:
+    // the client has drawn the last frame
+    _preview.ready(client);
+    break;
+  default:
+    break;
+  }
+}
+
+// Sends the shown pixels to the preview clients that are ready for them
+void Webserver::publishFrame(const uint8_t *pixels, uint16_t count, const uint8_t *bgPixels, uint16_t bgCount)
+{
+  for (uint8_t slot = 0; slot < PREVIEW_CLIENTS; slot++)
+  {
+    size_t length = _preview.encode(slot, pixels, count, bgPixels, bgCount);
+    if (length > 0)
+    {
+      _previewServer.sendBIN(_preview.client(slot), _preview.message(), length);
+    }
+  }
 }
 
 void Webserver::_handleDataGet(Config &config)
 {
-  String response;
-  config.load();
-  DynamicJsonDocument doc(2048);
-  config.configToJSON(doc);
-  serializeJson(doc, response);
-  _server.send(200, "text/json", response);
+  // the config in RAM is the current one, its generation changes with
+  // every update and the boot id keeps ETags from earlier boots apart
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%08x-%u\"", (unsigned)_bootId, (unsigned)config.generation);
+  _server.sendHeader("ETag", etag);
+  _server.sendHeader("Cache-Control", "no-cache");
+  if (_server.header("If-None-Match") == etag)
+  {
+    _server.send(304);
+    return;
+  }
+
+  ChunkedResponse response(200, "text/json");
+  config.writeJSON(response);
 }
 
 void Webserver::_handleDataPut(Config &config)
 {
-  String response;
-  DynamicJsonDocument doc(2048);
-  deserializeJson(doc, _server.arg(0));
-  bool save = config.JSONToConfig(doc);
-  config.tainted = true;
-  if (save)
+  const String &body = _server.arg(0);
   {
-    config.save();
+    ChunkedResponse response(200, "text/json");
+    config.putJSON(body.c_str(), body.length(), response);
+  }
+  if (config.forceReset)
+  {
+    Serial.println("Config change required reboot!");
+    delay(2000);
+    ESP.restart();
+  };
+}
+
+// Applies only the fields in the request and answers with the ones that
+// changed, so a slider move does not send the whole config back and forth
+void Webserver::_handleDataPatch(Config &config)
+{
+  const String &body = _server.arg(0);
+  DynamicJsonDocument changes(Config::patchCapacity(body.length()));
+  if (!config.patchJSON(body.c_str(), body.length(), changes))
+  {
+    _server.send(400, "text/plain", "Invalid JSON");
+    return;
+  }
+  {
+    ChunkedResponse response(200, "text/json");
+    serializeJson(changes, response);
   }
-  config.configToJSON(doc);
-  serializeJson(doc, response);
-  _server.send(200, "text/json", response);
   if (config.forceReset)
   {
     Serial.println("Config change required reboot!");
@@ -90,7 +257,15 @@ void Webserver::_handleTime()
   _server.send(200, "text/plain", buf);
 }
 
-void Webserver::setup(Config &config)
+void Webserver::_handleStats(Stats &stats)
+{
+  DynamicJsonDocument doc(3072);
+  stats.toJSON(doc);
+  ChunkedResponse response(200, "text/json");
+  serializeJson(doc, response);
+}
+
+void Webserver::setup(Config &config, Stats &stats, Mqtt &mqtt)
 {
   // SSDP.setSchemaURL("description.xml");
   // SSDP.setHTTPPort(80);
@@ -100,32 +275,50 @@ void Webserver::setup(Config &config)
   // SSDP.setModelNumber(VERSION);
   // SSDP.setModelURL("https://github.com/merlinschumacher/esp8266-clock");
   // SSDP.begin();
-  _server.on("/", HTTP_GET, [this, &config]()
-             { _handleIndex(config.config.language); });
-  _server.on("/index.html", HTTP_GET, [this, &config]()
-             { _handleIndex(config.config.language); });
-  _server.on("/styles.css", HTTP_GET, [this]()
-             { _server.sendHeader("Content-Encoding", "gzip");_server.send_P(200, "text/css", styles_css_gz, styles_css_gz_len); });
-  _server.on("/scripts.js", HTTP_GET, [this]()
-             { _server.sendHeader("Content-Encoding", "gzip");_server.send_P(200, "application/javascript", scripts_js_gz, scripts_js_gz_len); });
-
-  _server.on("/time", HTTP_GET, [this]()
-             { _handleTime(); });
-  _server.on("/wificonf", HTTP_GET, [this]()
-             { _handleWifiConf(); });
-  _server.on("/version", HTTP_GET, [this]()
-             { _server.send(200, "text/plain", VERSION); });
-
-  _server.on("/reset", HTTP_GET, [this, &config]()
-             { _resetConfig(config); _server.send(200, "text/plain", ""); });
-
-  _server.on("/data.json", HTTP_GET, [this, &config]()
-             { _handleDataGet(config); });
-  _server.on("/data.json", HTTP_POST, [this, &config]()
-             { _handleDataPut(config); });
+#if defined(ESP8266)
+  _bootId = ESP.random();
+#elif defined(ESP32)
+  _bootId = esp_random();
+#endif
+  const char *headerKeys[] = {"If-None-Match"};
+  _server.collectHeaders(headerKeys, 1);
+  _on("/", HTTP_GET, [this, &config]()
+      { _handleIndex(config.config.language); });
+  _on("/index.html", HTTP_GET, [this, &config]()
+      { _handleIndex(config.config.language); });
+  _on("/styles.css", HTTP_GET, [this]()
+      { _server.sendHeader("Content-Encoding", "gzip");_server.send_P(200, "text/css", styles_css_gz, styles_css_gz_len); });
+  _on("/scripts.js", HTTP_GET, [this]()
+      { _server.sendHeader("Content-Encoding", "gzip");_server.send_P(200, "application/javascript", scripts_js_gz, scripts_js_gz_len); });
+
+  _on("/time", HTTP_GET, [this]()
+      { _handleTime(); });
+  _on("/wificonf", HTTP_GET, [this]()
+      { _handleWifiConf(); });
+  _on("/version", HTTP_GET, [this]()
+      { _server.send(200, "text/plain", VERSION); });
+
+  _on("/reset", HTTP_GET, [this, &config]()
+      { _resetConfig(config); _server.send(200, "text/plain", ""); });
+
+  _on("/data.json", HTTP_GET, [this, &config]()
+      { _handleDataGet(config); });
+  _on("/data.json", HTTP_POST, [this, &config]()
+      { _handleDataPut(config); });
+  _on("/data.json", HTTP_PATCH, [this, &config]()
+      { _handleDataPatch(config); });
+  _on("/stats.json", HTTP_GET, [this, &stats]()
+      { _handleStats(stats); });
+
+  _on("/metrics", HTTP_GET, [this, &config, &stats, &mqtt]()
+      { _handleMetrics(config, stats, mqtt); });
+
+  _previewServer.begin();
+  _previewServer.onEvent([this](uint8_t client, WStype_t type, uint8_t *payload, size_t length)
+                         { _handlePreviewEvent(client, type); });
 
   _server.onNotFound([this]()
-                     { _server.send(404, "text/plain", "File not found"); });
+                     { _notFoundRequests++; _server.send(404, "text/plain", "File not found"); });
   // _server.on("/description.xml", HTTP_GET, []()
   //            { SSDP.schema(_server.client()); });
 #if defined(ESP8266)
@@ -0,0 +1,160 @@
+#ifndef native_arduino_h
+#define native_arduino_h
+// Minimal Arduino core stand-in for the native (host) environment.
+// Time only advances when the test advances it, so render code that
+// depends on millis()/micros() behaves deterministically.
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+
+// Only declared, like in the cores, so headers can name it
+class __FlashStringHelper;
+#define F(string_literal) (string_literal)
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--)
+        {
+            n += write(*buffer++);
+        }
+        return n;
+    }
+    size_t write(const char *str)
+    {
+        return write(reinterpret_cast<const uint8_t *>(str), strlen(str));
+    }
+    size_t print(const char *str)
+    {
+        return write(str);
+    }
+    size_t println(const char *str)
+    {
+        return write(str) + write("\n");
+    }
+    size_t printf(const char *format, ...)
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (len < 0)
+        {
+            return 0;
+        }
+        return write(reinterpret_cast<const uint8_t *>(buffer), min<size_t>(len, sizeof(buffer) - 1));
+    }
+    virtual void flush()
+    {
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual size_t readBytes(char *buffer, size_t length)
+    {
+        size_t n = 0;
+        int c;
+        while (n < length && (c = read()) >= 0)
+        {
+            buffer[n++] = static_cast<char>(c);
+        }
+        return n;
+    }
+};
+
+// Serial goes to stdout
+class NativeSerial : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        return fputc(c, stdout) == EOF ? 0 : 1;
+    }
+    void begin(unsigned long)
+    {
+    }
+};
+
+inline NativeSerial Serial;
+
+class EspClass
+{
+public:
+    uint32_t getChipId()
+    {
+        return 0xC10C4;
+    }
+    void restart()
+    {
+        restartCount++;
+    }
+    uint32_t restartCount = 0;
+};
+
+inline EspClass ESP;
+
+inline uint64_t nativeMicros = 0;
+
+inline unsigned long micros()
+{
+    return static_cast<unsigned long>(nativeMicros);
+}
+
+inline unsigned long millis()
+{
+    return static_cast<unsigned long>(nativeMicros / 1000);
+}
+
+inline void nativeAdvanceMicros(uint32_t us)
+{
+    nativeMicros += us;
+}
+
+inline void delay(unsigned long ms)
+{
+    nativeMicros += static_cast<uint64_t>(ms) * 1000;
+}
+
+inline void yield()
+{
+}
+
+inline long random(long howbig)
+{
+    return howbig > 0 ? rand() % howbig : 0;
+}
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size > 0)
+    {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+#endif // native_arduino_h
@@ -0,0 +1,119 @@
+#ifndef native_fs_h
+#define native_fs_h
+// Filesystem stand-in for the native environment, backed by a directory
+// on the host so config files survive between runs and can be inspected.
+#include <Arduino.h>
+#include <string>
+
+inline std::string nativeFsRoot = "/tmp";
+
+class File : public Stream
+{
+public:
+    File(FILE *file = nullptr) : _file(file)
+    {
+    }
+    explicit operator bool() const
+    {
+        return _file != nullptr;
+    }
+    size_t write(uint8_t c) override
+    {
+        return _file && fputc(c, _file) != EOF ? 1 : 0;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        return _file ? fwrite(buffer, 1, size, _file) : 0;
+    }
+    int available() override
+    {
+        if (!_file)
+        {
+            return 0;
+        }
+        long pos = ftell(_file);
+        fseek(_file, 0, SEEK_END);
+        long end = ftell(_file);
+        fseek(_file, pos, SEEK_SET);
+        return static_cast<int>(end - pos);
+    }
+    int read() override
+    {
+        return _file ? fgetc(_file) : -1;
+    }
+    size_t read(uint8_t *buffer, size_t size)
+    {
+        return _file ? fread(buffer, 1, size, _file) : 0;
+    }
+    size_t readBytes(char *buffer, size_t length) override
+    {
+        return read(reinterpret_cast<uint8_t *>(buffer), length);
+    }
+    size_t size()
+    {
+        return static_cast<size_t>(available());
+    }
+    void flush() override
+    {
+        if (_file)
+        {
+            fflush(_file);
+        }
+    }
+    // Like on the device the file is only closed explicitly
+    void close()
+    {
+        if (_file)
+        {
+            fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+private:
+    FILE *_file;
+};
+
+class FS
+{
+public:
+    bool begin()
+    {
+        return true;
+    }
+    File open(const char *path, const char *mode)
+    {
+        std::string fopenMode = mode[0] == 'r' ? "rb" : mode[0] == 'a' ? "ab" : "wb";
+        return File(fopen(_path(path).c_str(), fopenMode.c_str()));
+    }
+    bool exists(const char *path)
+    {
+        FILE *file = fopen(_path(path).c_str(), "rb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        fclose(file);
+        return true;
+    }
+    bool remove(const char *path)
+    {
+        return ::remove(_path(path).c_str()) == 0;
+    }
+    bool rename(const char *from, const char *to)
+    {
+        return ::rename(_path(from).c_str(), _path(to).c_str()) == 0;
+    }
+    bool format()
+    {
+        return true;
+    }
+
+private:
+    std::string _path(const char *path)
+    {
+        return nativeFsRoot + "/" + (path[0] == '/' ? path + 1 : path);
+    }
+};
+
+#endif // native_fs_h
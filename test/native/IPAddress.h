@@ -0,0 +1,30 @@
+#ifndef native_ipaddress_h
+#define native_ipaddress_h
+#include <Arduino.h>
+#include <arpa/inet.h>
+
+// Holds the address in network byte order like the Arduino IPAddress
+class IPAddress
+{
+public:
+    IPAddress(uint32_t address = 0) : _address(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : _address(htonl((uint32_t)a << 24 | (uint32_t)b << 16 | (uint32_t)c << 8 | d)) {}
+    operator uint32_t() const { return _address; }
+
+    bool fromString(const char *address)
+    {
+        in_addr parsed;
+        if (inet_pton(AF_INET, address, &parsed) != 1)
+        {
+            return false;
+        }
+        _address = parsed.s_addr;
+        return true;
+    }
+
+private:
+    uint32_t _address;
+};
+
+#endif // native_ipaddress_h
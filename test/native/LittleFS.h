@@ -0,0 +1,7 @@
+#ifndef native_littlefs_h
+#define native_littlefs_h
+#include "FS.h"
+
+inline FS LittleFS;
+
+#endif // native_littlefs_h
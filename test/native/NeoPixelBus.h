@@ -0,0 +1,281 @@
+#ifndef native_neopixelbus_h
+#define native_neopixelbus_h
+// Host stand-in for the parts of NeoPixelBus the clock uses. The color
+// conversions follow the library's float implementations so that render
+// timings on the host reflect the same amount of work as on the device.
+#include <Arduino.h>
+
+struct HsbColor;
+
+struct RgbColor
+{
+    RgbColor() : R(0), G(0), B(0) {}
+    RgbColor(uint8_t r, uint8_t g, uint8_t b) : R(r), G(g), B(b) {}
+    explicit RgbColor(uint8_t brightness) : R(brightness), G(brightness), B(brightness) {}
+    RgbColor(const HsbColor &color);
+
+    bool operator==(const RgbColor &other) const
+    {
+        return R == other.R && G == other.G && B == other.B;
+    }
+    bool operator!=(const RgbColor &other) const
+    {
+        return !(*this == other);
+    }
+
+    uint8_t CalculateBrightness() const
+    {
+        return static_cast<uint8_t>((static_cast<uint16_t>(R) + G + B) / 3);
+    }
+
+    RgbColor Dim(uint8_t ratio) const
+    {
+        return RgbColor(_elementDim(R, ratio), _elementDim(G, ratio), _elementDim(B, ratio));
+    }
+
+    static RgbColor LinearBlend(const RgbColor &left, const RgbColor &right, float progress)
+    {
+        return RgbColor(left.R + ((right.R - left.R) * progress),
+                        left.G + ((right.G - left.G) * progress),
+                        left.B + ((right.B - left.B) * progress));
+    }
+
+    uint8_t R;
+    uint8_t G;
+    uint8_t B;
+
+private:
+    static uint8_t _elementDim(uint8_t value, uint8_t ratio)
+    {
+        return (static_cast<uint16_t>(value) * (static_cast<uint16_t>(ratio) + 1)) >> 8;
+    }
+};
+
+struct HsbColor
+{
+    HsbColor() : H(0), S(0), B(0) {}
+    HsbColor(float h, float s, float b) : H(h), S(s), B(b) {}
+    HsbColor(const RgbColor &color)
+    {
+        float r = color.R / 255.0f;
+        float g = color.G / 255.0f;
+        float b = color.B / 255.0f;
+
+        float max = (r > g && r > b) ? r : (g > b) ? g : b;
+        float min = (r < g && r < b) ? r : (g < b) ? g : b;
+        float d = max - min;
+
+        float h = 0.0f;
+        float v = max;
+        float s = (v == 0.0f) ? 0 : (d / v);
+
+        if (d != 0.0f)
+        {
+            if (r == max)
+            {
+                h = (g - b) / d + (g < b ? 6.0f : 0.0f);
+            }
+            else if (g == max)
+            {
+                h = (b - r) / d + 2.0f;
+            }
+            else
+            {
+                h = (r - g) / d + 4.0f;
+            }
+            h /= 6.0f;
+        }
+
+        H = h;
+        S = s;
+        B = v;
+    }
+
+    float H;
+    float S;
+    float B;
+};
+
+inline RgbColor::RgbColor(const HsbColor &color)
+{
+    float r;
+    float g;
+    float b;
+
+    float h = color.H;
+    float s = color.S;
+    float v = color.B;
+
+    if (color.S == 0.0f)
+    {
+        r = g = b = v;
+    }
+    else
+    {
+        if (h < 0.0f)
+        {
+            h += 1.0f;
+        }
+        else if (h >= 1.0f)
+        {
+            h -= 1.0f;
+        }
+        h *= 6.0f;
+        int i = static_cast<int>(h);
+        float f = h - i;
+        float q = v * (1.0f - s * f);
+        float p = v * (1.0f - s);
+        float t = v * (1.0f - s * (1.0f - f));
+        switch (i)
+        {
+        case 0:
+            r = v, g = t, b = p;
+            break;
+        case 1:
+            r = q, g = v, b = p;
+            break;
+        case 2:
+            r = p, g = v, b = t;
+            break;
+        case 3:
+            r = p, g = q, b = v;
+            break;
+        case 4:
+            r = t, g = p, b = v;
+            break;
+        default:
+            r = v, g = p, b = q;
+            break;
+        }
+    }
+
+    R = static_cast<uint8_t>(r * 255.0f);
+    G = static_cast<uint8_t>(g * 255.0f);
+    B = static_cast<uint8_t>(b * 255.0f);
+}
+
+// Pixels are stored in wire order (G, R, B) like the real NeoGrbFeature.
+class NeoGrbFeature
+{
+public:
+    typedef RgbColor ColorObject;
+    static const size_t PixelSize = 3;
+
+    static void applyPixelColor(uint8_t *pixels, uint16_t index, ColorObject color)
+    {
+        uint8_t *p = pixels + index * PixelSize;
+        *p++ = color.G;
+        *p++ = color.R;
+        *p = color.B;
+    }
+
+    static ColorObject retrievePixelColor(const uint8_t *pixels, uint16_t index)
+    {
+        const uint8_t *p = pixels + index * PixelSize;
+        ColorObject color;
+        color.G = *p++;
+        color.R = *p++;
+        color.B = *p;
+        return color;
+    }
+};
+
+// Stands in for the ESP8266/ESP32 output methods; Show() only counts.
+class NeoNativeMethod
+{
+};
+
+template <typename T_COLOR_FEATURE, typename T_METHOD>
+class NeoPixelBus
+{
+public:
+    NeoPixelBus(uint16_t countPixels, uint8_t pin)
+        : _countPixels(countPixels), _pin(pin)
+    {
+        _pixels = static_cast<uint8_t *>(calloc(PixelsSize() ? PixelsSize() : 1, 1));
+    }
+
+    ~NeoPixelBus()
+    {
+        free(_pixels);
+    }
+
+    void Begin()
+    {
+    }
+
+    void Show()
+    {
+        showCount++;
+    }
+
+    bool CanShow() const
+    {
+        return true;
+    }
+
+    void Dirty()
+    {
+    }
+
+    uint8_t *Pixels()
+    {
+        return _pixels;
+    }
+
+    size_t PixelsSize() const
+    {
+        return static_cast<size_t>(_countPixels) * T_COLOR_FEATURE::PixelSize;
+    }
+
+    uint16_t PixelCount() const
+    {
+        return _countPixels;
+    }
+
+    void SetPixelColor(uint16_t indexPixel, typename T_COLOR_FEATURE::ColorObject color)
+    {
+        if (indexPixel < _countPixels)
+        {
+            T_COLOR_FEATURE::applyPixelColor(_pixels, indexPixel, color);
+        }
+    }
+
+    typename T_COLOR_FEATURE::ColorObject GetPixelColor(uint16_t indexPixel) const
+    {
+        if (indexPixel < _countPixels)
+        {
+            return T_COLOR_FEATURE::retrievePixelColor(_pixels, indexPixel);
+        }
+        return typename T_COLOR_FEATURE::ColorObject();
+    }
+
+    void ClearTo(typename T_COLOR_FEATURE::ColorObject color)
+    {
+        for (uint16_t i = 0; i < _countPixels; i++)
+        {
+            T_COLOR_FEATURE::applyPixelColor(_pixels, i, color);
+        }
+    }
+
+    void RotateRight(uint16_t rotationCount)
+    {
+        if (rotationCount == 0 || _countPixels < 2)
+        {
+            return;
+        }
+        rotationCount %= _countPixels;
+        const size_t shift = rotationCount * T_COLOR_FEATURE::PixelSize;
+        const size_t size = PixelsSize();
+        std::rotate(_pixels, _pixels + size - shift, _pixels + size);
+    }
+
+    uint32_t showCount = 0;
+
+private:
+    const uint16_t _countPixels;
+    const uint8_t _pin;
+    uint8_t *_pixels;
+};
+
+#endif // native_neopixelbus_h
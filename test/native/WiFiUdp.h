@@ -0,0 +1,128 @@
+#ifndef native_wifiudp_h
+#define native_wifiudp_h
+// WiFiUDP stand-in for the native environment on top of a non-blocking
+// host socket, so a sender on the same machine can feed the clock.
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include "IPAddress.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class WiFiUDP
+{
+public:
+    ~WiFiUDP()
+    {
+        stop();
+    }
+
+    uint8_t begin(uint16_t port)
+    {
+        stop();
+        _socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (_socket < 0)
+        {
+            return 0;
+        }
+        int reuse = 1;
+        setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            stop();
+            return 0;
+        }
+        return 1;
+    }
+
+    void stop()
+    {
+        if (_socket >= 0)
+        {
+            close(_socket);
+            _socket = -1;
+        }
+        _size = _position = 0;
+    }
+
+    // Receives the next datagram, returns its size or 0 if none is queued
+    int parsePacket()
+    {
+        _size = _position = 0;
+        if (_socket < 0)
+        {
+            return 0;
+        }
+        sockaddr_in remote = {};
+        socklen_t remoteLength = sizeof(remote);
+        ssize_t n = recvfrom(_socket, _buffer, sizeof(_buffer), MSG_DONTWAIT,
+                             reinterpret_cast<sockaddr *>(&remote), &remoteLength);
+        _size = n > 0 ? static_cast<size_t>(n) : 0;
+        _remote = remote;
+        return static_cast<int>(_size);
+    }
+
+    IPAddress remoteIP()
+    {
+        return IPAddress(_remote.sin_addr.s_addr);
+    }
+
+    uint16_t remotePort()
+    {
+        return ntohs(_remote.sin_port);
+    }
+
+    int beginPacket(IPAddress address, uint16_t port)
+    {
+        _destination = {};
+        _destination.sin_family = AF_INET;
+        _destination.sin_addr.s_addr = address;
+        _destination.sin_port = htons(port);
+        _outgoing = 0;
+        return _socket >= 0;
+    }
+
+    size_t write(const uint8_t *data, size_t length)
+    {
+        size_t n = min(length, sizeof(_packet) - _outgoing);
+        memcpy(_packet + _outgoing, data, n);
+        _outgoing += n;
+        return n;
+    }
+
+    int endPacket()
+    {
+        ssize_t n = sendto(_socket, _packet, _outgoing, MSG_DONTWAIT,
+                           reinterpret_cast<sockaddr *>(&_destination), sizeof(_destination));
+        return n == static_cast<ssize_t>(_outgoing);
+    }
+
+    int available()
+    {
+        return static_cast<int>(_size - _position);
+    }
+
+    int read(uint8_t *buffer, size_t length)
+    {
+        size_t n = min(length, _size - _position);
+        memcpy(buffer, _buffer + _position, n);
+        _position += n;
+        return static_cast<int>(n);
+    }
+
+private:
+    int _socket = -1;
+    uint8_t _buffer[1500];
+    size_t _size = 0;
+    size_t _position = 0;
+    sockaddr_in _remote = {};
+    sockaddr_in _destination = {};
+    uint8_t _packet[1500];
+    size_t _outgoing = 0;
+};
+
+#endif // native_wifiudp_h
@@ -0,0 +1,33 @@
+#ifndef native_eztime_h
+#define native_eztime_h
+// Host stand-in for ezTime. The wall clock is a plain struct the test sets.
+#include <Arduino.h>
+
+struct NativeClock
+{
+    uint8_t hour = 0;
+    uint8_t minute = 0;
+    uint8_t second = 0;
+    uint8_t day = 1;
+    uint8_t month = 1;
+    uint8_t weekday = 1; // ezTime: 1 = sunday
+};
+
+inline NativeClock nativeClock;
+
+inline uint8_t hour() { return nativeClock.hour; }
+inline uint8_t minute() { return nativeClock.minute; }
+inline uint8_t second() { return nativeClock.second; }
+inline uint8_t day() { return nativeClock.day; }
+inline uint8_t month() { return nativeClock.month; }
+inline void events() {}
+
+class Timezone
+{
+public:
+    uint8_t weekday() { return nativeClock.weekday; }
+    bool setLocation(const char *) { return true; }
+    void setDefault() {}
+};
+
+#endif // native_eztime_h
@@ -0,0 +1,135 @@
+// Reconnect behaviour of the MQTT client against a broker that goes down,
+// simulated on the host.
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <unity.h>
+#include "backoff.hpp"
+
+static const uint32_t minDelay = 1000;
+static const uint32_t maxDelay = 60000;
+static const uint32_t connectTimeout = 1500;
+
+// Stands in for the broker, only reachable while up is set. A failed
+// attempt blocks for the connect timeout like an unanswered TCP connect.
+struct FakeBroker
+{
+    bool up = true;
+    uint32_t attempts = 0;
+
+    bool connect()
+    {
+        attempts++;
+        if (!up)
+        {
+            nativeAdvanceMicros(connectTimeout * 1000);
+        }
+        return up;
+    }
+};
+
+// Runs Mqtt::connect() once per second like loop() does, for the given
+// number of seconds. Returns the time spent blocked in connect attempts.
+static uint32_t runClient(FakeBroker &broker, Backoff &backoff, bool &connected, uint32_t seconds)
+{
+    uint32_t blocked = 0;
+    for (uint32_t i = 0; i < seconds; i++)
+    {
+        if (broker.up == false)
+        {
+            connected = false;
+        }
+        if (!connected && backoff.due(millis()))
+        {
+            uint32_t start = millis();
+            connected = broker.connect();
+            blocked += millis() - start;
+            if (connected)
+            {
+                backoff.reset();
+            }
+            else
+            {
+                backoff.failed(millis());
+            }
+        }
+        nativeAdvanceMicros(1000000);
+    }
+    return blocked;
+}
+
+void test_delay_grows_to_cap()
+{
+    Backoff backoff(minDelay, maxDelay);
+    uint32_t now = millis();
+    TEST_ASSERT_TRUE(backoff.due(now));
+    uint32_t expected = minDelay;
+    for (uint8_t i = 0; i < 12; i++)
+    {
+        backoff.failed(now);
+        uint32_t wait = backoff.remaining(now);
+        TEST_ASSERT_TRUE(wait >= expected / 2);
+        TEST_ASSERT_TRUE(wait <= expected);
+        TEST_ASSERT_FALSE(backoff.due(now + wait - 1));
+        TEST_ASSERT_TRUE(backoff.due(now + wait));
+        expected = min(expected * 2, maxDelay);
+    }
+    backoff.reset();
+    TEST_ASSERT_TRUE(backoff.due(now));
+}
+
+// The wait must also work across the millis() overflow
+void test_due_wraps()
+{
+    Backoff backoff(minDelay, maxDelay);
+    uint32_t now = 0xFFFFFF00;
+    backoff.failed(now);
+    TEST_ASSERT_FALSE(backoff.due(now + 1));
+    TEST_ASSERT_TRUE(backoff.due(now + minDelay));
+}
+
+// A ten minute outage costs a handful of attempts instead of one blocking
+// attempt every second, and the client is back soon after the broker.
+void test_broker_outage()
+{
+    FakeBroker broker;
+    Backoff backoff(minDelay, maxDelay);
+    bool connected = false;
+    runClient(broker, backoff, connected, 10);
+    TEST_ASSERT_TRUE(connected);
+    TEST_ASSERT_EQUAL_UINT32(1, broker.attempts);
+
+    broker.up = false;
+    broker.attempts = 0;
+    uint32_t blocked = runClient(broker, backoff, connected, 600);
+    printf("10 min outage: %u attempts, %u ms blocked (%u attempts without backoff)\n",
+           broker.attempts, blocked, 600 * 1000 / (1000 + connectTimeout));
+    TEST_ASSERT_LESS_OR_EQUAL(25, broker.attempts);
+    TEST_ASSERT_FALSE(connected);
+
+    broker.up = true;
+    uint32_t seconds = 0;
+    while (!connected)
+    {
+        runClient(broker, backoff, connected, 1);
+        seconds++;
+    }
+    printf("reconnected %u s after the broker came back\n", seconds);
+    TEST_ASSERT_LESS_OR_EQUAL(maxDelay / 1000 + 2, seconds);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_delay_grows_to_cap);
+    RUN_TEST(test_due_wraps);
+    RUN_TEST(test_broker_outage);
+    return UNITY_END();
+}
@@ -0,0 +1,521 @@
+// Heap usage of the config web requests and boot time config loading on
+// the host.
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <unity.h>
+#include <malloc.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include "config.hpp"
+#include "chunkedprint.hpp"
+
+Config config;
+
+// Every allocation goes through these wrappers so the live and peak heap
+// usage of a request can be read off after it finished.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static size_t heapLive = 0;
+static size_t heapPeak = 0;
+
+static void heapAdd(void *ptr)
+{
+    if (ptr != nullptr)
+    {
+        heapLive += malloc_usable_size(ptr);
+        heapPeak = max(heapPeak, heapLive);
+    }
+}
+
+static void heapRemove(void *ptr)
+{
+    if (ptr != nullptr)
+    {
+        heapLive -= malloc_usable_size(ptr);
+    }
+}
+
+extern "C" void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    heapAdd(ptr);
+    return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    heapAdd(ptr);
+    return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    heapRemove(ptr);
+    void *result = __libc_realloc(ptr, size);
+    heapAdd(result != nullptr ? result : ptr);
+    return result;
+}
+
+extern "C" void free(void *ptr)
+{
+    heapRemove(ptr);
+    __libc_free(ptr);
+}
+
+static void heapResetPeak()
+{
+    heapPeak = heapLive;
+}
+
+// Grows on the heap with every write like an Arduino String, this is
+// where the responses used to be assembled before sending.
+class StringResponse : public Print
+{
+public:
+    ~StringResponse()
+    {
+        free(_buffer);
+    }
+    size_t write(uint8_t c) override
+    {
+        return write(&c, 1);
+    }
+    size_t write(const uint8_t *data, size_t size) override
+    {
+        _buffer = static_cast<char *>(realloc(_buffer, _length + size + 1));
+        memcpy(_buffer + _length, data, size);
+        _length += size;
+        _buffer[_length] = '\0';
+        return size;
+    }
+
+private:
+    char *_buffer = nullptr;
+    size_t _length = 0;
+};
+
+// Stands in for the WiFiClient behind ChunkedResponse
+class ChunkedSink : public ChunkedPrint
+{
+public:
+    ~ChunkedSink()
+    {
+        flush();
+    }
+    size_t chunks = 0;
+    size_t sent = 0;
+
+protected:
+    void sendChunk(const char *data, size_t length) override
+    {
+        chunks++;
+        sent += length;
+    }
+};
+
+static std::string requestBody;
+
+static void setupConfig()
+{
+    DynamicJsonDocument doc(64);
+    config.JSONToConfig(doc);
+    config.snapshot();
+    strlcpy(config.config.mqttServer, "mqtt.example.org", sizeof(config.config.mqttServer));
+    strlcpy(config.config.mqttBaseTopic, "espclock/livingroom", sizeof(config.config.mqttBaseTopic));
+    config.set(config.config);
+
+    DynamicJsonDocument request(2048);
+    config.configToJSON(request);
+    requestBody.clear();
+    serializeJson(request, requestBody);
+}
+
+// GET /data.json
+template <typename Response>
+static size_t handleDataGet()
+{
+    size_t before = heapLive;
+    heapResetPeak();
+    {
+        Response response;
+        config.writeJSON(response);
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, heapLive);
+    return heapPeak - before;
+}
+
+// PUT /data.json, the request body is already held by the server
+template <typename Response>
+static size_t handleDataPut()
+{
+    size_t before = heapLive;
+    heapResetPeak();
+    {
+        Response response;
+        config.putJSON(requestBody.c_str(), requestBody.size(), response);
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, heapLive);
+    return heapPeak - before;
+}
+
+// PATCH /data.json with a single color as sent while a slider moves
+static size_t handleDataPatch(const char *body, JsonDocument *result = nullptr)
+{
+    size_t before = heapLive;
+    heapResetPeak();
+    {
+        DynamicJsonDocument changes(Config::patchCapacity(strlen(body)));
+        TEST_ASSERT_TRUE(config.patchJSON(body, strlen(body), changes));
+        ChunkedSink response;
+        serializeJson(changes, response);
+        if (result != nullptr)
+        {
+            *result = changes;
+        }
+    }
+    return heapPeak - before;
+}
+
+void test_chunked_print()
+{
+    std::string body(1000, 'x');
+    ChunkedSink sink;
+    sink.print("{");
+    sink.write(reinterpret_cast<const uint8_t *>(body.data()), body.size());
+    sink.write('}');
+    sink.flush();
+    TEST_ASSERT_EQUAL_UINT32(1002, sink.sent);
+    TEST_ASSERT_EQUAL_UINT32(4, sink.chunks);
+}
+
+void test_data_get_heap()
+{
+    setupConfig();
+    size_t string = handleDataGet<StringResponse>();
+    size_t chunked = handleDataGet<ChunkedSink>();
+    printf("GET /data.json  peak heap: string %5u bytes, chunked %5u bytes, response %u bytes\n",
+           (unsigned)string, (unsigned)chunked, (unsigned)requestBody.size());
+    TEST_ASSERT_LESS_OR_EQUAL(string - requestBody.size(), chunked);
+}
+
+void test_data_put_heap()
+{
+    setupConfig();
+    size_t string = handleDataPut<StringResponse>();
+    size_t chunked = handleDataPut<ChunkedSink>();
+    printf("PUT /data.json  peak heap: string %5u bytes, chunked %5u bytes, response %u bytes\n",
+           (unsigned)string, (unsigned)chunked, (unsigned)requestBody.size());
+    TEST_ASSERT_LESS_OR_EQUAL(string - requestBody.size(), chunked);
+}
+
+// A patch only touches the fields it names, validates them like a full
+// update and reports the ones that actually changed
+void test_patch_fields()
+{
+    setupConfig();
+    config.config.ledCount = 120;
+    config.set(config.config);
+    config.dirty = 0;
+    uint8_t brightness = config.config.hourColor.brightness;
+    DynamicJsonDocument changes(512);
+    handleDataPatch("{\"hourColor\":{\"hue\":17},\"frameRate\":500,\"blendColors\":true,\"ledRoot\":5}", &changes);
+    config.snapshot();
+
+    TEST_ASSERT_EQUAL_UINT16(17, config.config.hourColor.hue);
+    TEST_ASSERT_EQUAL_UINT8(brightness, config.config.hourColor.brightness);
+    TEST_ASSERT_EQUAL_UINT32(120, config.config.frameRate);
+    TEST_ASSERT_EQUAL_UINT32(4, config.config.ledRoot);
+    TEST_ASSERT_EQUAL_UINT32(120, config.config.ledCount);
+    TEST_ASSERT_EQUAL_UINT32(3, changes.size());
+    TEST_ASSERT_EQUAL_UINT32(17, changes["hourColor"]["hue"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(120, changes["frameRate"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(5, changes["ledRoot"].as<uint32_t>());
+    TEST_ASSERT_TRUE(config.dirty & CONFIG_DIRTY_GEOMETRY);
+
+    handleDataPatch("{\"hourColor\":{\"hue\":17},\"frameRate\":120}", &changes);
+    TEST_ASSERT_EQUAL_UINT32(0, changes.size());
+}
+
+void test_data_patch_heap()
+{
+    setupConfig();
+    size_t put = handleDataPut<ChunkedSink>();
+    size_t patch = handleDataPatch("{\"hourColor\":{\"hue\":200,\"brightness\":80}}");
+    printf("PATCH /data.json peak heap: %5u bytes, PUT %5u bytes\n", (unsigned)patch, (unsigned)put);
+    TEST_ASSERT_LESS_OR_EQUAL(put, patch);
+}
+
+static void writeJSONConfig()
+{
+    DynamicJsonDocument doc(2048);
+    config.configToJSON(doc);
+    File file = LittleFS.open("/data.json", "w");
+    serializeJson(doc, file);
+    file.close();
+}
+
+template <typename Load>
+static void benchmarkLoad(const char *name, Load load)
+{
+    const uint32_t rounds = 200;
+    size_t before = heapLive;
+    heapResetPeak();
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        TEST_ASSERT_TRUE(load());
+    }
+    auto end = std::chrono::steady_clock::now();
+    double us = std::chrono::duration<double, std::micro>(end - start).count() / rounds;
+    printf("load %-6s %8.1f us, peak heap %5u bytes\n", name, us, (unsigned)(heapPeak - before));
+}
+
+void test_load_paths()
+{
+    setupConfig();
+    config.config.hourColor = {17, 42};
+    config.set(config.config);
+    config.save();
+    writeJSONConfig();
+
+    benchmarkLoad("json", [] { return config.loadJSON(); });
+    config.set(ConfigData());
+    benchmarkLoad("binary", [] { return config.loadBinary(); });
+    config.snapshot();
+    TEST_ASSERT_EQUAL_UINT16(17, config.config.hourColor.hue);
+    TEST_ASSERT_EQUAL_UINT8(42, config.config.hourColor.brightness);
+    TEST_ASSERT_EQUAL_STRING("mqtt.example.org", config.config.mqttServer);
+}
+
+// load() migrates data.json once and reads config.bin from then on, the
+// JSON file stays for older firmware but is not read again
+void test_load_migrates_json()
+{
+    setupConfig();
+    config.config.ledCount = 120;
+    config.set(config.config);
+    writeJSONConfig();
+    LittleFS.remove("/config.bin");
+
+    config.set(ConfigData());
+    config.load();
+    config.snapshot();
+    TEST_ASSERT_EQUAL_UINT32(120, config.config.ledCount);
+    TEST_ASSERT_TRUE(LittleFS.exists("/config.bin"));
+    TEST_ASSERT_TRUE(LittleFS.exists("/data.json"));
+    TEST_ASSERT_FALSE(LittleFS.exists("/config.tmp"));
+
+    config.config.ledCount = 90;
+    config.set(config.config);
+    config.save();
+    config.set(ConfigData());
+    config.load();
+    config.snapshot();
+    TEST_ASSERT_EQUAL_UINT32(90, config.config.ledCount);
+
+    // a broken config.bin does not bring back the migrated settings
+    File file = LittleFS.open("/config.bin", "w");
+    file.write(reinterpret_cast<const uint8_t *>("broken"), 6);
+    file.close();
+    config.load();
+    config.snapshot();
+    TEST_ASSERT_EQUAL_UINT32(60, config.config.ledCount);
+    TEST_ASSERT_TRUE(config.loadBinary());
+}
+
+void test_load_rejects_corrupt_file()
+{
+    setupConfig();
+    config.save();
+
+    File file = LittleFS.open("/config.bin", "r");
+    std::string stored(file.size(), '\0');
+    file.read(reinterpret_cast<uint8_t *>(&stored[0]), stored.size());
+    file.close();
+
+    std::string corrupt = stored;
+    corrupt[sizeof(ConfigHeader) + 10] ^= 0x01;
+    file = LittleFS.open("/config.bin", "w");
+    file.write(reinterpret_cast<const uint8_t *>(corrupt.data()), corrupt.size());
+    file.close();
+    TEST_ASSERT_FALSE(config.loadBinary());
+
+    std::string outdated = stored;
+    outdated[4] = CONFIG_VERSION + 1;
+    file = LittleFS.open("/config.bin", "w");
+    file.write(reinterpret_cast<const uint8_t *>(outdated.data()), outdated.size());
+    file.close();
+    TEST_ASSERT_FALSE(config.loadBinary());
+}
+
+// A power loss between removing config.bin and renaming config.tmp, as
+// save() does on ESP32, keeps the saved config
+void test_load_interrupted_save()
+{
+    setupConfig();
+    config.config.ledCount = 75;
+    config.set(config.config);
+    config.save();
+    LittleFS.rename("/config.bin", "/config.tmp");
+
+    config.set(ConfigData());
+    TEST_ASSERT_TRUE(config.loadBinary());
+    config.snapshot();
+    TEST_ASSERT_EQUAL_UINT32(75, config.config.ledCount);
+    TEST_ASSERT_TRUE(LittleFS.exists("/config.bin"));
+    TEST_ASSERT_FALSE(LittleFS.exists("/config.tmp"));
+
+    // a temporary file cut short by the power loss is ignored
+    File file = LittleFS.open("/config.tmp", "w");
+    file.write(reinterpret_cast<const uint8_t *>("cut"), 3);
+    file.close();
+    TEST_ASSERT_TRUE(config.loadBinary());
+    LittleFS.remove("/config.bin");
+    TEST_ASSERT_FALSE(config.loadBinary());
+    LittleFS.remove("/config.tmp");
+}
+
+// A burst of changes ends up in a single flash write
+void test_save_coalescing()
+{
+    setupConfig();
+    config.save();
+    uint32_t writes = config.writeCount;
+
+    for (uint8_t i = 0; i < 20; i++)
+    {
+        config.config.hourColor.hue = i;
+        config.set(config.config);
+        config.requestSave();
+        nativeAdvanceMicros(200000);
+        TEST_ASSERT_FALSE(config.flush());
+    }
+    nativeAdvanceMicros(SAVE_QUIET_MS * 1000);
+    TEST_ASSERT_TRUE(config.flush());
+    TEST_ASSERT_FALSE(config.flush());
+    TEST_ASSERT_EQUAL_UINT32(writes + 1, config.writeCount);
+
+    // changes that never settle are written after SAVE_MAX_DELAY_MS
+    uint32_t waited = 0;
+    do
+    {
+        config.requestSave();
+        nativeAdvanceMicros(1000000);
+        waited += 1000;
+    } while (!config.flush());
+    TEST_ASSERT_EQUAL_UINT32(SAVE_MAX_DELAY_MS, waited);
+    TEST_ASSERT_EQUAL_UINT32(writes + 2, config.writeCount);
+
+    config.writeCount = 0;
+    TEST_ASSERT_TRUE(config.loadBinary());
+    config.snapshot();
+    TEST_ASSERT_EQUAL_UINT32(writes + 2, config.writeCount);
+    TEST_ASSERT_EQUAL_UINT16(19, config.config.hourColor.hue);
+}
+
+// Updates are prepared in the inactive buffer and only show up in the
+// snapshot once published
+void test_snapshot()
+{
+    setupConfig();
+    config.snapshot();
+    TEST_ASSERT_FALSE(config.snapshot());
+    uint32_t ledCount = config.config.ledCount;
+    config.dirty = 0;
+
+    DynamicJsonDocument changes(256);
+    handleDataPatch("{\"ledCount\":42}", &changes);
+    TEST_ASSERT_EQUAL_UINT32(ledCount, config.config.ledCount);
+    TEST_ASSERT_TRUE(config.dirty & CONFIG_DIRTY_GEOMETRY);
+    TEST_ASSERT_TRUE(config.snapshot());
+    TEST_ASSERT_EQUAL_UINT32(42, config.config.ledCount);
+
+    // a patch without changes publishes nothing
+    handleDataPatch("{\"ledCount\":42}", &changes);
+    TEST_ASSERT_FALSE(config.snapshot());
+}
+
+// Only the groups of the changed fields are marked dirty
+void test_dirty_groups()
+{
+    setupConfig();
+    DynamicJsonDocument changes(256);
+    config.dirty = 0;
+    handleDataPatch("{\"hourColor\":{\"brightness\":12}}", &changes);
+    TEST_ASSERT_EQUAL_UINT32(CONFIG_DIRTY_COLORS, config.dirty);
+
+    config.dirty = 0;
+    handleDataPatch("{\"ledCount\":90,\"mqttServer\":\"broker\"}", &changes);
+    TEST_ASSERT_EQUAL_UINT32(CONFIG_DIRTY_GEOMETRY | CONFIG_DIRTY_STRIP | CONFIG_DIRTY_MQTT, config.dirty);
+
+    config.dirty = 0;
+    handleDataPatch("{\"ledCount\":90}", &changes);
+    TEST_ASSERT_EQUAL_UINT32(0, config.dirty);
+}
+
+// Single fields are parsed without JSON and clamped like the JSON config
+void test_set_field()
+{
+    setupConfig();
+    config.dirty = 0;
+    TEST_ASSERT_TRUE(config.setField("hourColor/brightness", "40"));
+    TEST_ASSERT_EQUAL_UINT32(CONFIG_DIRTY_COLORS, config.dirty);
+    TEST_ASSERT_FALSE(config.setField("hourColor/brightness", "40"));
+    TEST_ASSERT_TRUE(config.setField("nightTimeBegins", "9999"));
+    TEST_ASSERT_TRUE(config.setField("fluidMotion", "off"));
+    TEST_ASSERT_TRUE(config.setField("ledRoot", "5"));
+    TEST_ASSERT_FALSE(config.setField("frameRate", "60fps"));
+    TEST_ASSERT_FALSE(config.setField("mqttPort", "1884"));
+    TEST_ASSERT_FALSE(config.setField("hourColor", "40"));
+
+    config.snapshot();
+    TEST_ASSERT_EQUAL_UINT8(40, config.config.hourColor.brightness);
+    TEST_ASSERT_EQUAL_UINT16(1440, config.config.nightTimeBegins);
+    TEST_ASSERT_FALSE(config.config.fluidMotion);
+    TEST_ASSERT_EQUAL_UINT32(4, config.config.ledRoot);
+
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++)
+    {
+        if (strcmp(Config::fieldName(i), "ledRoot") == 0)
+        {
+            TEST_ASSERT_EQUAL_UINT32(5, config.fieldValue(i));
+        }
+    }
+    TEST_ASSERT_NULL(Config::fieldName(CONFIG_FIELD_COUNT));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    char fsRoot[] = "/tmp/espclock-XXXXXX";
+    nativeFsRoot = mkdtemp(fsRoot);
+    UNITY_BEGIN();
+    RUN_TEST(test_chunked_print);
+    RUN_TEST(test_data_get_heap);
+    RUN_TEST(test_data_put_heap);
+    RUN_TEST(test_patch_fields);
+    RUN_TEST(test_snapshot);
+    RUN_TEST(test_dirty_groups);
+    RUN_TEST(test_data_patch_heap);
+    RUN_TEST(test_load_paths);
+    RUN_TEST(test_load_migrates_json);
+    RUN_TEST(test_load_rejects_corrupt_file);
+    RUN_TEST(test_load_interrupted_save);
+    RUN_TEST(test_save_coalescing);
+    RUN_TEST(test_set_field);
+    std::filesystem::remove_all(fsRoot);
+    return UNITY_END();
+}
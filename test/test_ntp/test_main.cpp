@@ -0,0 +1,230 @@
+// Exchanges with an NTP server stand-in on the loopback interface. The
+// client is polled like loop() does it, none of the polls may block.
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include "ntp.hpp"
+
+static const uint16_t serverPort = 12300;
+static const uint64_t serverTime = 1774699200123456ULL; // 2026-03-28 12:00:00.123456 UTC
+static const double pollBudget = 500000;                // ns a poll may take at most
+
+static WiFiUDP server;
+static double slowestPoll = 0;
+
+static void write64(uint8_t *p, uint64_t value)
+{
+    for (int8_t i = 7; i >= 0; i--)
+    {
+        p[i] = value;
+        value >>= 8;
+    }
+}
+
+static uint64_t toNtp(uint64_t time)
+{
+    uint64_t seconds = time / 1000000 + 2208988800ULL;
+    return seconds << 32 | ((time % 1000000) << 32) / 1000000;
+}
+
+// Waits for a request and answers it with time as the server clock. The
+// request travels as long as the reply, and both take the simulated
+// micros() of the clock.
+static bool serve(uint64_t time, uint32_t travel, bool matching = true)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (server.parsePacket() != NTP_PACKET_SIZE)
+    {
+        if (std::chrono::steady_clock::now() - start > std::chrono::seconds(1))
+        {
+            return false;
+        }
+    }
+    uint8_t request[NTP_PACKET_SIZE];
+    server.read(request, sizeof(request));
+    nativeAdvanceMicros(travel);
+
+    uint8_t reply[NTP_PACKET_SIZE] = {};
+    reply[0] = 0x24; // version 4, server mode
+    reply[1] = 2;
+    memcpy(reply + 24, request + 40, 8);
+    reply[24] ^= matching ? 0 : 1;
+    write64(reply + 32, toNtp(time));
+    write64(reply + 40, toNtp(time));
+    server.beginPacket(server.remoteIP(), server.remotePort());
+    server.write(reply, sizeof(reply));
+    server.endPacket();
+    nativeAdvanceMicros(travel);
+    return true;
+}
+
+static uint8_t timedPoll(NtpClient &ntp)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint8_t result = ntp.poll(micros());
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    slowestPoll = max(slowestPoll, ns);
+    return result;
+}
+
+// Polls until the reply got handled or a second of real time passed
+static uint8_t pollReply(NtpClient &ntp)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+    {
+        uint8_t result = timedPoll(ntp);
+        if (result != NTP_NONE)
+        {
+            return result;
+        }
+    }
+    return NTP_NONE;
+}
+
+// The first reply steps the clock, the next one with the server 5 ms
+// ahead slews it
+void test_step_then_slew()
+{
+    WallClock clock;
+    NtpClient ntp(clock);
+    ntp.begin(IPAddress(127, 0, 0, 1), serverPort);
+
+    TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    TEST_ASSERT_EQUAL_UINT32(1, ntp.stats.requests);
+    TEST_ASSERT_TRUE(serve(serverTime, 10000));
+    TEST_ASSERT_EQUAL_UINT8(NTP_STEPPED, pollReply(ntp));
+    TEST_ASSERT_TRUE(clock.synced());
+    TEST_ASSERT_EQUAL_UINT32(20000, ntp.stats.rtt);
+    TEST_ASSERT_TRUE(clock.time(micros()) == serverTime + 10000);
+
+    for (uint32_t i = 0; i < NTP_INTERVAL_US / 1000000; i++)
+    {
+        nativeAdvanceMicros(1000000);
+        clock.update(micros());
+        TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, ntp.stats.requests);
+    uint64_t requested = clock.time(micros());
+    TEST_ASSERT_TRUE(serve(requested + 10000 + 5000, 10000));
+    TEST_ASSERT_EQUAL_UINT8(NTP_SLEWED, pollReply(ntp));
+    TEST_ASSERT_EQUAL_INT32(5000, ntp.stats.offset);
+    TEST_ASSERT_EQUAL_INT32(5000, clock.pendingSlew());
+    // 5 ms behind after 1024 s, the clock runs slow by about 4.9 ppm
+    TEST_ASSERT_INT32_WITHIN(10, -4883, ntp.stats.drift);
+
+    uint64_t before = clock.time(micros());
+    for (uint8_t i = 0; i < 20; i++)
+    {
+        nativeAdvanceMicros(1000000);
+        clock.update(micros());
+    }
+    TEST_ASSERT_EQUAL_INT32(0, clock.pendingSlew());
+    TEST_ASSERT_TRUE(clock.time(micros()) == before + 20000000 + 5000);
+    TEST_ASSERT_EQUAL_UINT32(1, ntp.stats.steps);
+    printf("slowest poll %.0f ns\n", slowestPoll);
+    TEST_ASSERT_TRUE(slowestPoll < pollBudget);
+}
+
+// Lost requests and stray replies neither block nor change the clock
+void test_timeout_and_stray_reply()
+{
+    WallClock clock;
+    clock.sync(serverTime, micros());
+    NtpClient ntp(clock);
+    ntp.begin(IPAddress(127, 0, 0, 1), serverPort);
+
+    TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    uint32_t sent = micros();
+    while (micros() - sent < NTP_TIMEOUT_US)
+    {
+        TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+        nativeAdvanceMicros(16666);
+    }
+    TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    TEST_ASSERT_EQUAL_UINT32(1, ntp.stats.timeouts);
+
+    // the retry gets answered, but not to the request it asked
+    nativeAdvanceMicros(NTP_RETRY_US);
+    TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    TEST_ASSERT_EQUAL_UINT32(2, ntp.stats.requests);
+    server.parsePacket(); // drops the first request
+    TEST_ASSERT_TRUE(serve(serverTime + 60000000, 1000, false));
+    auto start = std::chrono::steady_clock::now();
+    while (ntp.stats.invalid == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+    {
+        TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, ntp.stats.invalid);
+    TEST_ASSERT_EQUAL_UINT32(0, ntp.stats.replies);
+    TEST_ASSERT_EQUAL_UINT32(0, ntp.stats.steps);
+    printf("slowest poll %.0f ns\n", slowestPoll);
+    TEST_ASSERT_TRUE(slowestPoll < pollBudget);
+}
+
+// Lets the request sent by the next poll time out
+static void timeOut(NtpClient &ntp)
+{
+    TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    nativeAdvanceMicros(NTP_TIMEOUT_US);
+    TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    server.parsePacket(); // drops the request
+    nativeAdvanceMicros(NTP_RETRY_US);
+}
+
+// Only timeouts in a row ask for the server name to be looked up again,
+// a reply or a new server starts counting over
+void test_needs_resolve()
+{
+    WallClock clock;
+    clock.sync(serverTime, micros());
+    NtpClient ntp(clock);
+    ntp.begin(IPAddress(127, 0, 0, 1), serverPort);
+
+    for (uint8_t i = 0; i < NTP_RESOLVE_TIMEOUTS; i++)
+    {
+        TEST_ASSERT_FALSE(ntp.needsResolve());
+        timeOut(ntp);
+    }
+    TEST_ASSERT_EQUAL_UINT32(NTP_RESOLVE_TIMEOUTS, ntp.stats.timeouts);
+    TEST_ASSERT_TRUE(ntp.needsResolve());
+    ntp.begin(IPAddress(127, 0, 0, 1), serverPort);
+    TEST_ASSERT_FALSE(ntp.needsResolve());
+
+    for (uint8_t i = 0; i < NTP_RESOLVE_TIMEOUTS - 1; i++)
+    {
+        timeOut(ntp);
+    }
+    TEST_ASSERT_EQUAL_UINT8(NTP_NONE, timedPoll(ntp));
+    TEST_ASSERT_TRUE(serve(clock.time(micros()), 1000));
+    TEST_ASSERT_EQUAL_UINT8(NTP_SLEWED, pollReply(ntp));
+    nativeAdvanceMicros(NTP_INTERVAL_US);
+    for (uint8_t i = 0; i < NTP_RESOLVE_TIMEOUTS - 1; i++)
+    {
+        timeOut(ntp);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2 * NTP_RESOLVE_TIMEOUTS + 1, ntp.stats.timeouts);
+    TEST_ASSERT_FALSE(ntp.needsResolve());
+    printf("slowest poll %.0f ns\n", slowestPoll);
+    TEST_ASSERT_TRUE(slowestPoll < pollBudget);
+}
+
+void setUp()
+{
+    server.begin(serverPort);
+}
+
+void tearDown()
+{
+    server.stop();
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_step_then_slew);
+    RUN_TEST(test_timeout_and_stray_reply);
+    RUN_TEST(test_needs_resolve);
+    return UNITY_END();
+}
@@ -0,0 +1,117 @@
+// Size of the live preview messages, which should grow with the number
+// of changed pixels and not with the length of the strips.
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+#include "preview.hpp"
+
+static const uint16_t ledCount = 360;
+static const uint16_t bgLedCount = 60;
+
+static void setPixel(std::vector<uint8_t> &pixels, uint16_t i, uint8_t r, uint8_t g, uint8_t b)
+{
+    pixels[i * 3] = g;
+    pixels[i * 3 + 1] = r;
+    pixels[i * 3 + 2] = b;
+}
+
+static uint16_t read16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+void test_keyframe_then_delta()
+{
+    Preview preview;
+    std::vector<uint8_t> pixels(ledCount * 3), bgPixels(bgLedCount * 3);
+    TEST_ASSERT_TRUE(preview.connect(4));
+    TEST_ASSERT_EQUAL_INT32(4, preview.client(0));
+
+    size_t length = preview.encode(0, pixels.data(), ledCount, bgPixels.data(), bgLedCount);
+    TEST_ASSERT_EQUAL_UINT8(PREVIEW_KEYFRAME, preview.message()[0]);
+    TEST_ASSERT_EQUAL_UINT32(ledCount, read16(preview.message() + 1));
+    TEST_ASSERT_EQUAL_UINT32(bgLedCount, read16(preview.message() + 3));
+    TEST_ASSERT_EQUAL_UINT32(PREVIEW_HEADER_SIZE + (ledCount + bgLedCount) * 3 + 2 * PREVIEW_RUN_SIZE, length);
+
+    // nothing is sent until the client acknowledged the frame
+    setPixel(pixels, 10, 1, 2, 3);
+    TEST_ASSERT_EQUAL_UINT32(0, preview.encode(0, pixels.data(), ledCount, bgPixels.data(), bgLedCount));
+    preview.ready(4);
+    length = preview.encode(0, pixels.data(), ledCount, bgPixels.data(), bgLedCount);
+    TEST_ASSERT_EQUAL_UINT32(PREVIEW_HEADER_SIZE + PREVIEW_RUN_SIZE + 3, length);
+    const uint8_t *run = preview.message() + PREVIEW_HEADER_SIZE;
+    TEST_ASSERT_EQUAL_UINT32(10, read16(run));
+    TEST_ASSERT_EQUAL_UINT8(1, run[2]);
+    TEST_ASSERT_EQUAL_UINT8(1, run[3]);
+    TEST_ASSERT_EQUAL_UINT8(2, run[4]);
+    TEST_ASSERT_EQUAL_UINT8(3, run[5]);
+
+    preview.ready(4);
+    TEST_ASSERT_EQUAL_UINT32(0, preview.encode(0, pixels.data(), ledCount, bgPixels.data(), bgLedCount));
+}
+
+// A moving seconds hand costs the same on any strip length
+void test_delta_size()
+{
+    Preview preview;
+    preview.connect(0);
+    std::vector<uint8_t> pixels(ledCount * 3), bgPixels(bgLedCount * 3);
+    setPixel(pixels, 0, 0, 0, 255);
+    preview.encode(0, pixels.data(), ledCount, bgPixels.data(), bgLedCount);
+    for (uint16_t second = 1; second < 60; second++)
+    {
+        setPixel(pixels, (second - 1) * 6, 0, 0, 0);
+        setPixel(pixels, second * 6, 0, 0, 255);
+        preview.ready(0);
+        size_t length = preview.encode(0, pixels.data(), ledCount, bgPixels.data(), bgLedCount);
+        TEST_ASSERT_EQUAL_UINT32(PREVIEW_HEADER_SIZE + 2 * (PREVIEW_RUN_SIZE + 3), length);
+    }
+
+    // neighbouring changes with a single unchanged pixel between them
+    // share one run, the background follows the clock pixels
+    setPixel(pixels, 100, 9, 9, 9);
+    setPixel(pixels, 102, 9, 9, 9);
+    setPixel(bgPixels, 0, 9, 9, 9);
+    preview.ready(0);
+    size_t length = preview.encode(0, pixels.data(), ledCount, bgPixels.data(), bgLedCount);
+    TEST_ASSERT_EQUAL_UINT32(PREVIEW_HEADER_SIZE + 2 * PREVIEW_RUN_SIZE + 4 * 3, length);
+    TEST_ASSERT_EQUAL_UINT32(ledCount, read16(preview.message() + PREVIEW_HEADER_SIZE + PREVIEW_RUN_SIZE + 9));
+    printf("%u frames, %u bytes, %.1f bytes per frame for %u pixels\n", preview.framesSent, preview.bytesSent,
+           (double)preview.bytesSent / preview.framesSent, ledCount + bgLedCount);
+}
+
+void test_clients()
+{
+    Preview preview;
+    std::vector<uint8_t> pixels(60 * 3);
+    TEST_ASSERT_TRUE(preview.connect(1));
+    TEST_ASSERT_TRUE(preview.connect(2));
+    TEST_ASSERT_FALSE(preview.connect(3));
+    preview.encode(0, pixels.data(), 60, nullptr, 0);
+    preview.disconnect(1);
+    TEST_ASSERT_EQUAL_INT32(-1, preview.client(0));
+    TEST_ASSERT_TRUE(preview.connect(3));
+
+    // a new client and a resized strip start with a keyframe
+    TEST_ASSERT_EQUAL_UINT32(PREVIEW_HEADER_SIZE + PREVIEW_RUN_SIZE + 60 * 3, preview.encode(0, pixels.data(), 60, nullptr, 0));
+    preview.ready(3);
+    TEST_ASSERT_EQUAL_UINT32(PREVIEW_HEADER_SIZE + PREVIEW_RUN_SIZE + 30 * 3, preview.encode(0, pixels.data(), 30, nullptr, 0));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_keyframe_then_delta);
+    RUN_TEST(test_delta_size);
+    RUN_TEST(test_clients);
+    return UNITY_END();
+}
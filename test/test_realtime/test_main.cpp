@@ -0,0 +1,212 @@
+// Realtime pixel stream over UDP, fed by a sender on the loopback
+// interface like a controller on the network would.
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "realtime.hpp"
+
+static const uint16_t pixelCount = 60;
+static const uint16_t bgPixelCount = 10;
+static const size_t frameSize = (pixelCount + bgPixelCount) * 3;
+
+static void sendTo(uint16_t port, const std::vector<uint8_t> &packet)
+{
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    sendto(sender, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    close(sender);
+}
+
+// Every byte of frame n differs, so order and offsets can be checked
+static std::vector<uint8_t> rgbFrame(uint8_t n, size_t size)
+{
+    std::vector<uint8_t> rgb(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        rgb[i] = static_cast<uint8_t>(n * 31 + i);
+    }
+    return rgb;
+}
+
+static std::vector<uint8_t> ddpPacket(uint8_t sequence, uint32_t offset, const uint8_t *data, uint16_t length, bool push)
+{
+    std::vector<uint8_t> packet = {static_cast<uint8_t>(0x40 | (push ? 0x01 : 0)), sequence, 0x0B, 1,
+                                   static_cast<uint8_t>(offset >> 24), static_cast<uint8_t>(offset >> 16),
+                                   static_cast<uint8_t>(offset >> 8), static_cast<uint8_t>(offset),
+                                   static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length)};
+    packet.resize(10 + length);
+    memcpy(&packet[10], data, length);
+    return packet;
+}
+
+static std::vector<uint8_t> e131Packet(uint16_t universe, uint8_t sequence, const uint8_t *data, uint16_t length)
+{
+    std::vector<uint8_t> packet(126 + length);
+    packet[1] = 0x10;
+    memcpy(&packet[4], "ASC-E1.17", 9);
+    packet[21] = 4;
+    packet[43] = 2;
+    packet[108] = 100;
+    packet[111] = sequence;
+    packet[113] = universe >> 8;
+    packet[114] = universe;
+    packet[117] = 2;
+    packet[118] = 0xA1;
+    packet[122] = 1;
+    packet[123] = (length + 1) >> 8;
+    packet[124] = length + 1;
+    memcpy(&packet[126], data, length);
+    return packet;
+}
+
+// Sends frame n as two DDP packets, the second one pushes it
+static void ingestDDPFrame(Realtime &realtime, uint8_t n)
+{
+    std::vector<uint8_t> rgb = rgbFrame(n, frameSize);
+    std::vector<uint8_t> first = ddpPacket(n * 2 % 15 + 1, 0, rgb.data(), 100, false);
+    std::vector<uint8_t> second = ddpPacket((n * 2 + 1) % 15 + 1, 100, rgb.data() + 100, frameSize - 100, true);
+    realtime.ingestDDP(first.data(), first.size(), millis());
+    realtime.ingestDDP(second.data(), second.size(), millis());
+}
+
+static void waitForFrames(Realtime &realtime, uint32_t frames)
+{
+    for (int i = 0; i < 1000 && realtime.stats.received < frames; i++)
+    {
+        realtime.receive(millis());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// The strips hold GRB, the sender sends RGB
+static void assertFrame(uint8_t n, const uint8_t *pixels, const uint8_t *bgPixels)
+{
+    std::vector<uint8_t> rgb = rgbFrame(n, frameSize);
+    for (size_t i = 0; i < frameSize; i += 3)
+    {
+        const uint8_t *p = i < pixelCount * 3u ? pixels + i : bgPixels + i - pixelCount * 3;
+        TEST_ASSERT_EQUAL_UINT8(rgb[i + 1], p[0]);
+        TEST_ASSERT_EQUAL_UINT8(rgb[i], p[1]);
+        TEST_ASSERT_EQUAL_UINT8(rgb[i + 2], p[2]);
+    }
+}
+
+void test_ddp_loopback()
+{
+    Realtime realtime;
+    realtime.resize(pixelCount, bgPixelCount);
+    realtime.begin();
+    for (uint8_t n = 0; n < 2; n++)
+    {
+        std::vector<uint8_t> rgb = rgbFrame(n, frameSize);
+        sendTo(REALTIME_DDP_PORT, ddpPacket(n * 2 + 1, 0, rgb.data(), 100, false));
+        sendTo(REALTIME_DDP_PORT, ddpPacket(n * 2 + 2, 100, rgb.data() + 100, frameSize - 100, true));
+    }
+    waitForFrames(realtime, 2);
+    TEST_ASSERT_EQUAL_UINT32(2, realtime.stats.received);
+
+    uint8_t pixels[pixelCount * 3];
+    uint8_t bgPixels[bgPixelCount * 3];
+    TEST_ASSERT_TRUE(realtime.present(pixels, bgPixels, millis()));
+    assertFrame(0, pixels, bgPixels);
+    TEST_ASSERT_TRUE(realtime.present(pixels, bgPixels, millis()));
+    assertFrame(1, pixels, bgPixels);
+    TEST_ASSERT_EQUAL_UINT32(0, realtime.stats.invalid);
+}
+
+void test_e131_loopback()
+{
+    Realtime realtime;
+    realtime.resize(200, 0);
+    realtime.begin();
+    std::vector<uint8_t> rgb = rgbFrame(3, 600);
+    sendTo(REALTIME_E131_PORT, e131Packet(REALTIME_E131_UNIVERSE, 1, rgb.data(), 510));
+    sendTo(REALTIME_E131_PORT, e131Packet(REALTIME_E131_UNIVERSE + 1, 1, rgb.data() + 510, 90));
+    waitForFrames(realtime, 1);
+    TEST_ASSERT_EQUAL_UINT32(1, realtime.stats.received);
+
+    // a repeated sequence number is a late packet
+    std::vector<uint8_t> repeated = e131Packet(REALTIME_E131_UNIVERSE, 1, rgb.data(), 510);
+    TEST_ASSERT_FALSE(realtime.ingestE131(repeated.data(), repeated.size(), millis()));
+    TEST_ASSERT_EQUAL_UINT32(1, realtime.stats.late);
+
+    std::vector<uint8_t> terminated = e131Packet(REALTIME_E131_UNIVERSE, 2, rgb.data(), 510);
+    terminated[112] = 0x40;
+    realtime.ingestE131(terminated.data(), terminated.size(), millis());
+    TEST_ASSERT_FALSE(realtime.active(millis()));
+}
+
+// Frames arriving in a burst fill the buffer, the oldest ones get
+// dropped and the rest is played out one per tick
+void test_jitter_buffer()
+{
+    Realtime realtime;
+    realtime.resize(pixelCount, bgPixelCount);
+    uint8_t pixels[pixelCount * 3];
+    uint8_t bgPixels[bgPixelCount * 3];
+
+    ingestDDPFrame(realtime, 0);
+    TEST_ASSERT_TRUE(realtime.active(millis()));
+    // prebuffering, nothing is shown yet
+    TEST_ASSERT_TRUE(realtime.present(pixels, bgPixels, millis()));
+    TEST_ASSERT_EQUAL_UINT32(0, realtime.stats.shown);
+
+    for (uint8_t n = 1; n < 6; n++)
+    {
+        ingestDDPFrame(realtime, n);
+    }
+    TEST_ASSERT_EQUAL_UINT32(6, realtime.stats.received);
+    TEST_ASSERT_EQUAL_UINT32(3, realtime.stats.dropped);
+    for (uint8_t n = 3; n < 6; n++)
+    {
+        realtime.present(pixels, bgPixels, millis());
+        assertFrame(n, pixels, bgPixels);
+    }
+    realtime.present(pixels, bgPixels, millis());
+    TEST_ASSERT_EQUAL_UINT32(1, realtime.stats.underruns);
+    assertFrame(5, pixels, bgPixels);
+
+    // a packet from before the last one is discarded
+    std::vector<uint8_t> rgb = rgbFrame(9, frameSize);
+    std::vector<uint8_t> old = ddpPacket(10, 0, rgb.data(), frameSize, true);
+    TEST_ASSERT_FALSE(realtime.ingestDDP(old.data(), old.size(), millis()));
+    TEST_ASSERT_EQUAL_UINT32(1, realtime.stats.late);
+}
+
+void test_timeout()
+{
+    Realtime realtime;
+    realtime.resize(pixelCount, bgPixelCount);
+    uint8_t pixels[pixelCount * 3];
+    uint8_t bgPixels[bgPixelCount * 3];
+    ingestDDPFrame(realtime, 0);
+    nativeAdvanceMicros((REALTIME_TIMEOUT_MS - 1) * 1000);
+    TEST_ASSERT_TRUE(realtime.present(pixels, bgPixels, millis()));
+    nativeAdvanceMicros(1000);
+    TEST_ASSERT_FALSE(realtime.active(millis()));
+    TEST_ASSERT_FALSE(realtime.present(pixels, bgPixels, millis()));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_ddp_loopback);
+    RUN_TEST(test_e131_loopback);
+    RUN_TEST(test_jitter_buffer);
+    RUN_TEST(test_timeout);
+    return UNITY_END();
+}
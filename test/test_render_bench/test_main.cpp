@@ -0,0 +1,438 @@
+// Frame time benchmark for the render pipeline on the host.
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <NeoPixelBus.h>
+#include <ezTime.h>
+#include <unity.h>
+#include <chrono>
+#include <vector>
+#include "config.hpp"
+#include "wallclock.hpp"
+#include "vars.hpp"
+#include "timefunc.hpp"
+#include "color.hpp"
+#include "led.hpp"
+#include "render.hpp"
+
+static const char *hourHandStyles[] = {"simple", "split", "wide"};
+static const uint32_t benchFrames = 3600; // one minute at 60 FPS
+static const uint32_t frameBudget = 16666;
+
+static void setupClock(uint16_t ledCount)
+{
+    config.config = {};
+    config.config.hourColor = {0, 100};
+    config.config.minuteColor = {120, 100};
+    config.config.secondColor = {240, 100};
+    config.config.hourDot = true;
+    config.config.hourQuarter = true;
+    config.config.hourSegment = true;
+    config.config.hourDotColor = {30, 20};
+    config.config.hourQuarterColor = {240, 40};
+    config.config.hourSegmentColor = {60, 10};
+    config.config.dayMonth = true;
+    config.config.dayColor = {312, 100};
+    config.config.monthColor = {59, 100};
+    config.config.weekdayColor = {167, 100};
+    config.config.bgLight = true;
+    config.config.bgColor = {200, 30};
+    config.config.ledCount = ledCount;
+    config.config.bgLedCount = ledCount;
+    config.config.ledRoot = 0;
+    config.config.clockLedCount = ledCount;
+    config.config.dayOffset = 0;
+    config.config.monthOffset = 31;
+    config.config.weekdayOffset = 43;
+    buildPositions(config.config);
+    frameStats = FrameStats();
+    setFrameRate(60);
+    initStrip();
+    updateColors(false);
+}
+
+// Replays one minute of loop() starting at 10:08:00 so that the seconds
+// hand sweeps over the other hands and the blend path gets exercised.
+static double runFrames()
+{
+    currentHour = 10;
+    currentMinute = 8;
+    currentSecond = 60;
+    currentDayPos = calculateDayHand();
+    currentMonthPos = calculateMonthHand();
+    currentWeekdayPos = calculateWeekdayHand();
+    uint32_t rendered = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < benchFrames; i++)
+    {
+        uint8_t s = (i / 60) % 60;
+        if (currentSecond != s)
+        {
+            currentSecond = s;
+            frame = 0;
+            secondStart = micros();
+            compositor.invalidate(LAYER_BIT(LAYER_HANDS));
+        }
+        if (tick())
+        {
+            renderTime();
+            setBacklight();
+            showStrips();
+            rendered++;
+        }
+        nativeAdvanceMicros(frameBudget);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    TEST_ASSERT_EQUAL_UINT32(benchFrames, rendered);
+    TEST_ASSERT_EQUAL_UINT32(0, frameStats.dropped);
+    return std::chrono::duration<double, std::nano>(end - start).count() / rendered;
+}
+
+static void benchmarkLedCount(uint16_t ledCount)
+{
+    for (const char *style : hourHandStyles)
+    {
+        for (int blend = 0; blend < 2; blend++)
+        {
+            for (int fluid = 0; fluid < 2; fluid++)
+            {
+                setupClock(ledCount);
+                strlcpy(config.config.hourHandStyle, style, sizeof(config.config.hourHandStyle));
+                config.config.blendColors = blend;
+                config.config.fluidMotion = fluid;
+                skippedFrames = 0;
+                skippedBgFrames = 0;
+                double ns = runFrames();
+                printf("leds=%3u style=%-6s blend=%d fluid=%d %10.0f ns/frame (%.3f%% of budget) %4u frames skipped\n",
+                       ledCount, style, blend, fluid, ns, ns / (frameBudget * 10.0), skippedFrames);
+                // the static time changes once per second, smooth hands
+                // move with almost every frame, the backlight never changes
+                if (fluid)
+                    TEST_ASSERT_TRUE(skippedFrames < benchFrames / 60);
+                else
+                    TEST_ASSERT_EQUAL_UINT32(benchFrames - 60, skippedFrames);
+                TEST_ASSERT_EQUAL_UINT32(benchFrames - 1, skippedBgFrames);
+            }
+        }
+    }
+}
+
+// Blends every pair from a set of hues and brightness levels with both
+// kernels and reports their speed and how far the results differ.
+void test_blend_kernels()
+{
+    static const uint16_t hues[] = {0, 30, 60, 120, 180, 240, 300, 359};
+    static const uint8_t levels[] = {5, 20, 47, 75, 100};
+    std::vector<RgbColor> colors;
+    for (uint16_t hue : hues)
+    {
+        for (uint8_t level : levels)
+        {
+            colors.push_back(colorFromSetting({hue, level}));
+        }
+    }
+    for (uint8_t level : levels)
+    {
+        colors.push_back(RgbColor(HsbColor(0, 0, level / 100.0f)));
+    }
+
+    const size_t rounds = 200;
+    const size_t blends = rounds * colors.size() * colors.size();
+    uint32_t sink = 0;
+    int maxDeviation = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (const RgbColor &current : colors)
+        {
+            for (const RgbColor &color : colors)
+            {
+                sink += packColor(blendColorsHsb(current, color));
+            }
+        }
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (const RgbColor &current : colors)
+        {
+            for (const RgbColor &color : colors)
+            {
+                sink += blendColorsFixed(packColor(current), packColor(color));
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    for (const RgbColor &current : colors)
+    {
+        for (const RgbColor &color : colors)
+        {
+            RgbColor a = blendColorsHsb(current, color);
+            RgbColor b = unpackColor(blendColorsFixed(packColor(current), packColor(color)));
+            maxDeviation = max(maxDeviation, abs(a.R - b.R));
+            maxDeviation = max(maxDeviation, abs(a.G - b.G));
+            maxDeviation = max(maxDeviation, abs(a.B - b.B));
+            TEST_ASSERT_EQUAL_UINT8(maxChannel(packColor(a)), maxChannel(packColor(b)));
+        }
+    }
+
+    double hsb = std::chrono::duration<double, std::nano>(middle - start).count() / blends;
+    double fixed = std::chrono::duration<double, std::nano>(end - middle).count() / blends;
+    printf("blend float hsb %6.1f ns, fixed point %6.1f ns, max channel deviation %d (%u)\n",
+           hsb, fixed, maxDeviation, sink & 1);
+    TEST_ASSERT_LESS_OR_EQUAL(8, maxDeviation);
+}
+
+// With 60 LEDs the tables have to reproduce the layout the render
+// functions used to compute on every frame.
+void test_positions_60_leds()
+{
+    for (uint32_t root = 0; root < 60; root += 7)
+    {
+        config.config.ledCount = 60;
+        config.config.clockLedCount = 60;
+        config.config.ledRoot = root;
+        buildPositions(config.config);
+        for (uint8_t m = 0; m < 60; m++)
+        {
+            TEST_ASSERT_EQUAL_UINT32((m + root) % 60, calculateMinuteHand(m));
+            TEST_ASSERT_EQUAL_UINT32((m + 1 + root) % 60, positions.following[m]);
+        }
+        for (uint8_t h = 0; h < 24; h++)
+        {
+            uint8_t hourHand = (uint8_t)((h % 12) * 5 + 59 / 12 + root) % 60;
+            TEST_ASSERT_EQUAL_UINT32(hourHand, positions.led[positions.hourBase[h] + positions.hourProgress[59]]);
+            TEST_ASSERT_EQUAL_UINT32(5, positions.segmentLength[h]);
+        }
+    }
+}
+
+// A stalled loop() pass must not shift the following frames off the grid.
+void test_frame_scheduler()
+{
+    frameStats = FrameStats();
+    setFrameRate(60);
+    uint32_t start = micros();
+    TEST_ASSERT_TRUE(tick());
+    TEST_ASSERT_FALSE(tick());
+
+    nativeAdvanceMicros(16666 * 3 + 1000);
+    TEST_ASSERT_TRUE(tick());
+    TEST_ASSERT_EQUAL_UINT32(2, frameStats.dropped);
+    TEST_ASSERT_EQUAL_UINT32(1, frameStats.late);
+    TEST_ASSERT_EQUAL_UINT32(1000, frameStats.jitter);
+
+    nativeAdvanceMicros(16666 - 1000);
+    TEST_ASSERT_TRUE(tick());
+    TEST_ASSERT_EQUAL_UINT32(0, frameStats.jitter);
+    TEST_ASSERT_EQUAL_UINT32(start + 16666 * 4, frameStats.frameStart);
+    TEST_ASSERT_EQUAL_UINT32(3, frameStats.rendered);
+}
+
+// The rainbow moves with the time since it started, one pixel per
+// 1000 / speed ms, at a cost independent of how many pixels the strip has
+void test_animation()
+{
+    for (uint16_t ledCount : {60, 360})
+    {
+        setupClock(ledCount);
+        std::vector<uint8_t> pattern(ledCount * 3);
+        rainbowEffect.build(pattern.data(), ledCount, 255);
+        animation.stop();
+        night = false;
+        uint32_t start = millis();
+        renderAnimation(rainbowEffect);
+        TEST_ASSERT_EQUAL_UINT32(0, memcmp(strip->Pixels(), pattern.data(), pattern.size()));
+
+        const uint32_t frames = 3600;
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            nativeAdvanceMicros(frameBudget);
+            renderAnimation(rainbowEffect);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        uint16_t offset = (uint64_t)(millis() - start) * rainbowEffect.speed() / 1000 % ledCount;
+        for (uint16_t i = 0; i < ledCount; i++)
+        {
+            uint16_t source = (i + ledCount - offset) % ledCount;
+            TEST_ASSERT_EQUAL_UINT32(0, memcmp(strip->Pixels() + i * 3, pattern.data() + source * 3, 3));
+        }
+        printf("leds=%3u rainbow %6.0f ns/frame\n", ledCount,
+               std::chrono::duration<double, std::nano>(end - begin).count() / frames);
+    }
+    animation.stop();
+}
+
+// Frames composed from the cached layers have to match frames drawn from
+// scratch, also after something else drew on the strips.
+void test_compositor()
+{
+    for (int fluid = 0; fluid < 2; fluid++)
+    {
+        setupClock(120);
+        config.config.blendColors = true;
+        config.config.fluidMotion = fluid;
+        currentHour = 10;
+        currentMinute = 8;
+        currentDayPos = calculateDayHand();
+        currentMonthPos = calculateMonthHand();
+        currentWeekdayPos = calculateWeekdayHand();
+        std::vector<uint8_t> composed(strip->PixelsSize());
+        std::vector<uint8_t> background(bgStrip->PixelsSize());
+
+        for (uint32_t i = 0; i < 600; i++)
+        {
+            uint8_t s = i / 10 * 7 % 60;
+            if (currentSecond != s)
+            {
+                currentSecond = s;
+                secondStart = micros();
+                compositor.invalidate(LAYER_BIT(LAYER_HANDS));
+            }
+            if (i % 97 == 0)
+            {
+                rainbowEffect.build(strip->Pixels(), strip->PixelCount(), 255);
+                compositor.recompose();
+            }
+            tick();
+            renderTime();
+            setBacklight();
+            memcpy(composed.data(), strip->Pixels(), composed.size());
+            memcpy(background.data(), bgStrip->Pixels(), background.size());
+
+            compositor.invalidate(LAYERS_ALL);
+            clearStrips();
+            renderTime();
+            setBacklight();
+            TEST_ASSERT_EQUAL_UINT32(0, memcmp(composed.data(), strip->Pixels(), composed.size()));
+            TEST_ASSERT_EQUAL_UINT32(0, memcmp(background.data(), bgStrip->Pixels(), background.size()));
+            nativeAdvanceMicros(frameBudget);
+        }
+    }
+}
+
+// With fluid motion the seconds hand moves by the time that passed, also
+// over dropped frames and with any number of LEDs on the face.
+void test_smooth_hands()
+{
+    for (uint16_t ledCount : {60, 90, 360})
+    {
+        setupClock(ledCount);
+        config.config.ledRoot = 7;
+        buildPositions(config.config);
+        config.config.hourDot = false;
+        config.config.hourSegment = false;
+        config.config.dayMonth = false;
+        config.config.fluidMotion = true;
+        hourColor = minuteColor = off;
+        currentHour = 10;
+        currentMinute = 8;
+        currentSecond = 5;
+        secondStart = micros();
+        uint32_t start = secondStart;
+
+        for (uint32_t i = 0; i < 120; i++)
+        {
+            // drop up to two frames in a row
+            nativeAdvanceMicros(frameBudget * (1 + i % 3));
+            TEST_ASSERT_TRUE(tick());
+            if (frameStats.frameStart - secondStart >= 1000000)
+            {
+                currentSecond++;
+                secondStart += 1000000;
+                compositor.invalidate(LAYER_BIT(LAYER_HANDS));
+            }
+            renderTime();
+
+            double expected = (5000 + (frameStats.frameStart - start) / 1000) * ledCount / 60000.0;
+            uint16_t lower = ((uint16_t)expected + 7) % ledCount;
+            uint16_t upper = (lower + 1) % ledCount;
+            double lowerLevel = strip->GetPixelColor(lower).B;
+            double upperLevel = strip->GetPixelColor(upper).B;
+            TEST_ASSERT_TRUE(lowerLevel + upperLevel > 250);
+            double position = (uint16_t)expected + upperLevel / (lowerLevel + upperLevel);
+            TEST_ASSERT_TRUE(fabs(position - expected) < 0.01);
+            for (uint16_t led = 0; led < ledCount; led++)
+            {
+                if (led != lower && led != upper)
+                {
+                    TEST_ASSERT_EQUAL_UINT8(0, strip->GetPixelColor(led).B);
+                }
+            }
+        }
+    }
+}
+
+// A split hour hand keeps one logical position free between its halves,
+// with and without fluid motion and with any number of LEDs on the face.
+void test_split_hour_hand()
+{
+    for (uint16_t ledCount : {60, 120, 360})
+    {
+        setupClock(ledCount);
+        strlcpy(config.config.hourHandStyle, "split", sizeof(config.config.hourHandStyle));
+        uint16_t hourHand = positions.led[positions.hourBase[10]];
+        uint16_t spacing = ledCount / 60;
+
+        strip->ClearTo(off);
+        renderHourHand(10, 0);
+        for (uint16_t led = 0; led < ledCount; led++)
+        {
+            bool lit = led == hourHand - spacing || led == hourHand + spacing;
+            TEST_ASSERT_EQUAL_UINT8(lit ? hourColor.R : 0, strip->GetPixelColor(led).R);
+        }
+
+        strip->ClearTo(off);
+        renderSmoothHand(10 * 3600000, 43200000, -1, hourColor);
+        renderSmoothHand(10 * 3600000, 43200000, 1, hourColor);
+        for (uint16_t led = 0; led < ledCount; led++)
+        {
+            bool lit = led == hourHand - spacing || led == hourHand + spacing;
+            TEST_ASSERT_EQUAL_UINT8(lit ? hourColor.R : 0, strip->GetPixelColor(led).R);
+        }
+    }
+}
+
+void test_render_60_leds()
+{
+    benchmarkLedCount(60);
+}
+
+void test_render_120_leds()
+{
+    benchmarkLedCount(120);
+}
+
+void test_render_360_leds()
+{
+    benchmarkLedCount(360);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_blend_kernels);
+    RUN_TEST(test_positions_60_leds);
+    RUN_TEST(test_frame_scheduler);
+    RUN_TEST(test_animation);
+    RUN_TEST(test_compositor);
+    RUN_TEST(test_smooth_hands);
+    RUN_TEST(test_split_hour_hand);
+    RUN_TEST(test_render_60_leds);
+    RUN_TEST(test_render_120_leds);
+    RUN_TEST(test_render_360_leds);
+    return UNITY_END();
+}
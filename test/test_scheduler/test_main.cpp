@@ -0,0 +1,134 @@
+// Event times of the scheduler in a time zone with daylight saving time.
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <unity.h>
+#include "scheduler.hpp"
+
+static const uint32_t summerTime = 1774746000; // 2026-03-29 01:00 UTC
+static const uint32_t winterTime = 1792890000; // 2026-10-25 01:00 UTC
+static const uint32_t saturdayNoon = 1774699200; // 2026-03-28 12:00 UTC
+static const uint32_t hour = 3600;
+
+static int32_t centralEurope(uint32_t utc)
+{
+    return utc >= summerTime && utc < winterTime ? 2 * hour : hour;
+}
+
+static uint32_t calls[EVENT_COUNT];
+
+static void setupScheduler(Scheduler &scheduler)
+{
+    memset(calls, 0, sizeof(calls));
+    scheduler.setZone(centralEurope);
+    scheduler.on(EVENT_DST, []()
+                 { calls[EVENT_DST]++; });
+    scheduler.on(EVENT_NIGHT, []()
+                 { calls[EVENT_NIGHT]++; });
+    scheduler.on(EVENT_ALARM, []()
+                 { calls[EVENT_ALARM]++; });
+}
+
+// Night from 22:00 to 06:59 and an alarm at 06:30 over the night the
+// clocks go forward
+void test_events()
+{
+    Scheduler scheduler;
+    setupScheduler(scheduler);
+    ConfigData config = {};
+    config.nightTimeBegins = 22 * 60;
+    config.nightTimeEnds = 6 * 60 + 59;
+    config.alarmActive = true;
+    config.alarmTime = 6 * 60 + 30;
+
+    scheduler.plan(config, saturdayNoon);
+    for (uint32_t count : calls)
+    {
+        TEST_ASSERT_EQUAL_UINT32(1, count);
+    }
+    TEST_ASSERT_FALSE(scheduler.night());
+    TEST_ASSERT_FALSE(scheduler.alarm());
+    TEST_ASSERT_EQUAL_INT32(hour, scheduler.offset());
+    TEST_ASSERT_EQUAL_UINT32(summerTime, scheduler.next(EVENT_DST));
+    TEST_ASSERT_EQUAL_UINT32(saturdayNoon + 9 * hour, scheduler.next(EVENT_NIGHT));
+
+    for (uint32_t utc = saturdayNoon; utc < saturdayNoon + 9 * hour; utc++)
+    {
+        scheduler.update(utc);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, calls[EVENT_NIGHT]);
+    scheduler.update(saturdayNoon + 9 * hour);
+    TEST_ASSERT_EQUAL_UINT32(2, calls[EVENT_NIGHT]);
+    TEST_ASSERT_TRUE(scheduler.night());
+
+    // the alarm and the end of the night move with the offset
+    scheduler.update(summerTime);
+    TEST_ASSERT_EQUAL_UINT32(2, calls[EVENT_DST]);
+    TEST_ASSERT_EQUAL_INT32(2 * hour, scheduler.offset());
+    TEST_ASSERT_EQUAL_UINT32(winterTime, scheduler.next(EVENT_DST));
+    TEST_ASSERT_EQUAL_UINT32(summerTime + 3 * hour + 1800, scheduler.next(EVENT_ALARM));
+    TEST_ASSERT_EQUAL_UINT32(summerTime + 4 * hour, scheduler.next(EVENT_NIGHT));
+    TEST_ASSERT_EQUAL_UINT32(2, calls[EVENT_NIGHT]);
+
+    scheduler.update(summerTime + 3 * hour + 1800);
+    TEST_ASSERT_TRUE(scheduler.alarm());
+    scheduler.update(summerTime + 3 * hour + 1860);
+    TEST_ASSERT_FALSE(scheduler.alarm());
+    TEST_ASSERT_EQUAL_UINT32(3, calls[EVENT_ALARM]);
+    scheduler.update(summerTime + 4 * hour);
+    TEST_ASSERT_FALSE(scheduler.night());
+    TEST_ASSERT_EQUAL_UINT32(3, calls[EVENT_NIGHT]);
+}
+
+// A night that begins in the hour skipped by the change to summer time
+// begins with the change
+void test_skipped_hour()
+{
+    Scheduler scheduler;
+    setupScheduler(scheduler);
+    ConfigData config = {};
+    config.nightTimeBegins = 2 * 60 + 30;
+    config.nightTimeEnds = 5 * 60 + 59;
+
+    scheduler.plan(config, saturdayNoon);
+    TEST_ASSERT_FALSE(scheduler.night());
+    TEST_ASSERT_EQUAL_UINT32(SCHEDULE_NEVER, scheduler.next(EVENT_ALARM));
+    scheduler.update(summerTime);
+    TEST_ASSERT_TRUE(scheduler.night());
+    TEST_ASSERT_EQUAL_UINT32(2, calls[EVENT_NIGHT]);
+    TEST_ASSERT_EQUAL_UINT32(summerTime + 3 * hour, scheduler.next(EVENT_NIGHT));
+}
+
+// A night that ends where it begins lasts all day and is never due
+void test_all_day()
+{
+    Scheduler scheduler;
+    setupScheduler(scheduler);
+    ConfigData config = {};
+    config.nightTimeBegins = 0;
+    config.nightTimeEnds = 23 * 60 + 59;
+    scheduler.setZone(nullptr);
+
+    scheduler.plan(config, saturdayNoon);
+    TEST_ASSERT_TRUE(scheduler.night());
+    TEST_ASSERT_EQUAL_UINT32(SCHEDULE_NEVER, scheduler.next(EVENT_NIGHT));
+    TEST_ASSERT_EQUAL_UINT32(SCHEDULE_NEVER, scheduler.next(EVENT_DST));
+    scheduler.update(winterTime);
+    TEST_ASSERT_EQUAL_UINT32(1, calls[EVENT_NIGHT]);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_events);
+    RUN_TEST(test_skipped_hour);
+    RUN_TEST(test_all_day);
+    return UNITY_END();
+}
@@ -0,0 +1,223 @@
+// Exchanges MQTT-sized packets with a broker stand-in on the loopback
+// interface. The client is used like PubSubClient and loop() use it, none
+// of its calls may block.
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "resolver.hpp"
+#include "tcpclient.hpp"
+
+static const uint16_t brokerPort = 18830;
+static const double callBudget = 500000; // ns a call may take at most
+
+static int listener = -1;
+static int broker = -1; // the connection the broker accepted
+static double slowestCall = 0;
+
+// Runs call and keeps track of the slowest one
+template <typename Call>
+static auto timed(Call call)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto result = call();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    slowestCall = max(slowestCall, ns);
+    return result;
+}
+
+// Polls until the connect got through or failed, or a second passed
+static uint8_t waitOpen(TcpClient &client)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint8_t status = timed([&] { return client.status(); });
+    while (status == TCP_CONNECTING && std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+    {
+        status = timed([&] { return client.status(); });
+    }
+    return status;
+}
+
+static bool accept()
+{
+    auto start = std::chrono::steady_clock::now();
+    while (broker < 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+    {
+        broker = ::accept(listener, nullptr, nullptr);
+    }
+    if (broker >= 0)
+    {
+        fcntl(broker, F_SETFL, fcntl(broker, F_GETFL, 0) & ~O_NONBLOCK);
+        timeval wait = {1, 0};
+        setsockopt(broker, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+    }
+    return broker >= 0;
+}
+
+// Fills a packet with its number, so lost or cut packets show
+static void fill(uint8_t *packet, size_t size, uint32_t number)
+{
+    packet[0] = 0x30; // PUBLISH
+    for (size_t i = 1; i < size; i++)
+    {
+        packet[i] = number + i;
+    }
+}
+
+static void connect(TcpClient &client)
+{
+    TEST_ASSERT_TRUE(client.open(IPAddress(127, 0, 0, 1), brokerPort));
+    TEST_ASSERT_TRUE(accept());
+    TEST_ASSERT_EQUAL_UINT8(TCP_OPEN, waitOpen(client));
+    TEST_ASSERT_TRUE(client.connected());
+}
+
+// Packets pass both ways and the broker closing ends the connection
+void test_exchange()
+{
+    TcpClient client;
+    TEST_ASSERT_FALSE(client.connected());
+    connect(client);
+
+    static const uint8_t pingreq[] = {0xC0, 0};
+    static const uint8_t pingresp[] = {0xD0, 0};
+    TEST_ASSERT_EQUAL(sizeof(pingreq), timed([&] { return client.write(pingreq, sizeof(pingreq)); }));
+    TEST_ASSERT_EQUAL(0, client.queued());
+    uint8_t packet[2];
+    TEST_ASSERT_EQUAL(sizeof(packet), recv(broker, packet, sizeof(packet), MSG_WAITALL));
+    TEST_ASSERT_EQUAL_MEMORY(pingreq, packet, sizeof(pingreq));
+
+    TEST_ASSERT_EQUAL(0, timed([&] { return client.available(); }));
+    TEST_ASSERT_EQUAL(sizeof(pingresp), send(broker, pingresp, sizeof(pingresp), 0));
+    auto start = std::chrono::steady_clock::now();
+    while (timed([&] { return client.available(); }) == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+    {
+    }
+    TEST_ASSERT_EQUAL(0xD0, client.peek());
+    TEST_ASSERT_EQUAL(0xD0, client.read());
+    TEST_ASSERT_EQUAL(1, client.read(packet, sizeof(packet)));
+    TEST_ASSERT_EQUAL(0, packet[0]);
+
+    close(broker);
+    broker = -1;
+    start = std::chrono::steady_clock::now();
+    while (timed([&] { return client.connected(); }) && std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+    {
+    }
+    TEST_ASSERT_FALSE(client.connected());
+    TEST_ASSERT_EQUAL(0, client.write(pingreq, sizeof(pingreq)));
+    printf("slowest call %.0f ns\n", slowestCall);
+    TEST_ASSERT_TRUE(slowestCall < callBudget);
+}
+
+// A broker that does not read fills the socket. Packets then wait in the
+// buffer until it is full and are refused whole after that, so once the
+// broker reads again it gets every accepted packet complete and in order.
+void test_full_send_buffer()
+{
+    TcpClient client;
+    connect(client);
+
+    const size_t size = 200;
+    uint8_t packet[size];
+    uint32_t accepted = 0;
+    // thousands of writes until the socket is full, a blocking one would
+    // hang here, the refused ones are timed below
+    while (true)
+    {
+        fill(packet, size, accepted);
+        size_t written = client.write(packet, size);
+        if (written == 0)
+        {
+            break;
+        }
+        TEST_ASSERT_EQUAL(size, written);
+        accepted++;
+    }
+    TEST_ASSERT_EQUAL(0, timed([&] { return client.write(packet, size); }));
+    TEST_ASSERT_EQUAL_UINT8(TCP_OPEN, client.status());
+    TEST_ASSERT_TRUE(client.queued() > TCP_TX_BUFFER - size);
+    uint8_t large[TCP_TX_BUFFER + 1] = {};
+    TEST_ASSERT_EQUAL(0, timed([&] { return client.write(large, sizeof(large)); }));
+
+    uint8_t expected[size];
+    uint8_t received[size];
+    for (uint32_t i = 0; i < accepted; i++)
+    {
+        // loop() drains the buffer while the broker catches up
+        if (client.queued() > 0)
+        {
+            timed([&] { client.flush(); return 0; });
+        }
+        TEST_ASSERT_EQUAL(size, recv(broker, received, size, MSG_WAITALL));
+        fill(expected, size, i);
+        TEST_ASSERT_EQUAL_MEMORY(expected, received, size);
+    }
+    TEST_ASSERT_EQUAL(0, client.queued());
+    TEST_ASSERT_EQUAL(-1, recv(broker, received, size, MSG_DONTWAIT));
+    printf("%u packets of %u bytes accepted, slowest call %.0f ns\n", (unsigned)accepted, (unsigned)size, slowestCall);
+    TEST_ASSERT_TRUE(slowestCall < callBudget);
+}
+
+// Nobody listening fails the connect as soon as the stack reports it
+void test_nobody_listening()
+{
+    TcpClient client;
+    client.open(IPAddress(127, 0, 0, 1), brokerPort + 1);
+    TEST_ASSERT_EQUAL_UINT8(TCP_FAILED, waitOpen(client));
+    TEST_ASSERT_FALSE(client.connected());
+    printf("slowest call %.0f ns\n", slowestCall);
+    TEST_ASSERT_TRUE(slowestCall < callBudget);
+}
+
+void test_resolver()
+{
+    Resolver resolver;
+    TEST_ASSERT_EQUAL_UINT8(RESOLVE_IDLE, resolver.poll(millis()));
+    resolver.begin("127.0.0.1", millis());
+    TEST_ASSERT_EQUAL_UINT8(RESOLVE_DONE, resolver.poll(millis()));
+    TEST_ASSERT_TRUE(resolver.address() == IPAddress(127, 0, 0, 1));
+    resolver.begin("broker.local", millis());
+    TEST_ASSERT_EQUAL_UINT8(RESOLVE_FAILED, resolver.poll(millis()));
+}
+
+void setUp()
+{
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // a small window fills up quickly, like on the clock
+    int window = 4096;
+    setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &window, sizeof(window));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(brokerPort);
+    bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    listen(listener, 1);
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL, 0) | O_NONBLOCK);
+}
+
+void tearDown()
+{
+    if (broker >= 0)
+    {
+        close(broker);
+        broker = -1;
+    }
+    close(listener);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_exchange);
+    RUN_TEST(test_full_send_buffer);
+    RUN_TEST(test_nobody_listening);
+    RUN_TEST(test_resolver);
+    return UNITY_END();
+}
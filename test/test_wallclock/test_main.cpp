@@ -0,0 +1,122 @@
+// Boundaries and phase of the wall clock, which counts the time since the
+// last sync in micros().
+// Run with: pio test -e native -v
+#include <Arduino.h>
+#include <unity.h>
+#include "wallclock.hpp"
+
+// 2024-02-29 23:59:58 UTC, a thursday
+static const uint32_t leapDay = 1709251198;
+
+// The boundaries fall on the micros() the second actually began, not on
+// the first update() after it
+void test_boundaries()
+{
+    WallClock clock;
+    TEST_ASSERT_EQUAL_UINT8(0, clock.update(1000));
+
+    uint32_t start = 4294000000u; // micros() wraps during the test
+    clock.sync(leapDay * 1000000ULL + 250000, start);
+    TEST_ASSERT_EQUAL_UINT8(CLOCK_SECOND | CLOCK_MINUTE | CLOCK_HOUR | CLOCK_DAY, clock.update(start));
+    TEST_ASSERT_EQUAL_UINT8(23, clock.hour());
+    TEST_ASSERT_EQUAL_UINT8(59, clock.minute());
+    TEST_ASSERT_EQUAL_UINT8(58, clock.second());
+    TEST_ASSERT_EQUAL_UINT8(29, clock.day());
+    TEST_ASSERT_EQUAL_UINT8(2, clock.month());
+    TEST_ASSERT_EQUAL_UINT8(4, clock.weekday());
+    TEST_ASSERT_EQUAL_UINT32(start - 250000, clock.secondStart());
+    TEST_ASSERT_EQUAL_UINT32(250, clock.ms(start));
+
+    TEST_ASSERT_EQUAL_UINT8(0, clock.update(start + 749999));
+    TEST_ASSERT_EQUAL_UINT32(999, clock.ms(start + 749999));
+
+    // a loop pass that notices the second late still gets its exact start
+    TEST_ASSERT_EQUAL_UINT8(CLOCK_SECOND, clock.update(start + 763000));
+    TEST_ASSERT_EQUAL_UINT8(59, clock.second());
+    TEST_ASSERT_EQUAL_UINT32(start + 750000, clock.secondStart());
+    TEST_ASSERT_EQUAL_UINT32(13, clock.ms(start + 763000));
+
+    TEST_ASSERT_EQUAL_UINT8(CLOCK_SECOND | CLOCK_MINUTE | CLOCK_HOUR | CLOCK_DAY, clock.update(start + 1750000));
+    TEST_ASSERT_EQUAL_UINT8(0, clock.hour());
+    TEST_ASSERT_EQUAL_UINT8(0, clock.second());
+    TEST_ASSERT_EQUAL_UINT8(1, clock.day());
+    TEST_ASSERT_EQUAL_UINT8(3, clock.month());
+    TEST_ASSERT_EQUAL_UINT8(5, clock.weekday());
+    TEST_ASSERT_EQUAL_UINT32(start + 1750000, clock.secondStart());
+
+    // a stalled loop skips seconds but not the minute boundary
+    TEST_ASSERT_EQUAL_UINT8(CLOCK_SECOND | CLOCK_MINUTE, clock.update(start + 61900000));
+    TEST_ASSERT_EQUAL_UINT8(1, clock.minute());
+    TEST_ASSERT_EQUAL_UINT8(0, clock.second());
+    TEST_ASSERT_EQUAL_UINT32(150, clock.ms(start + 61900000));
+}
+
+// The offset of the time zone moves the boundaries, a resync that steps
+// the time back over a second reports it again
+void test_offset_and_resync()
+{
+    WallClock clock;
+    clock.setOffset(2 * 3600);
+    clock.sync(leapDay * 1000000ULL, 0);
+    clock.update(0);
+    TEST_ASSERT_EQUAL_UINT8(1, clock.hour());
+    TEST_ASSERT_EQUAL_UINT8(1, clock.day());
+    TEST_ASSERT_EQUAL_UINT8(3, clock.month());
+    TEST_ASSERT_EQUAL_UINT8(5, clock.weekday());
+
+    clock.setOffset(3600);
+    TEST_ASSERT_EQUAL_UINT8(CLOCK_SECOND | CLOCK_HOUR | CLOCK_MINUTE, clock.update(10));
+    TEST_ASSERT_EQUAL_UINT8(0, clock.hour());
+
+    TEST_ASSERT_EQUAL_UINT8(CLOCK_SECOND, clock.update(1000000));
+    TEST_ASSERT_EQUAL_UINT8(59, clock.second());
+    clock.sync(leapDay * 1000000ULL + 990000, 1000000);
+    TEST_ASSERT_EQUAL_UINT8(CLOCK_SECOND, clock.update(1000000));
+    TEST_ASSERT_EQUAL_UINT8(58, clock.second());
+    TEST_ASSERT_EQUAL_UINT32(990, clock.ms(1000000));
+    TEST_ASSERT_EQUAL_UINT8(CLOCK_SECOND, clock.update(1010000));
+    TEST_ASSERT_EQUAL_UINT8(59, clock.second());
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// Corrections are spread over the seconds and never turn the time back
+void test_slew()
+{
+    WallClock clock;
+    clock.sync(leapDay * 1000000ULL, 0);
+    clock.update(0);
+    clock.slew(1200);
+    for (uint32_t second = 1; second <= 3; second++)
+    {
+        clock.update(second * 1000000);
+    }
+    TEST_ASSERT_EQUAL_INT32(0, clock.pendingSlew());
+    TEST_ASSERT_TRUE(clock.time(3000000) == (leapDay + 3) * 1000000ULL + 1200);
+
+    // noticed 100 µs into the second, the time may only go back that far
+    clock.slew(-700);
+    uint32_t late = clock.secondStart() + 1000100;
+    uint64_t before = clock.time(late);
+    clock.update(late);
+    TEST_ASSERT_EQUAL_INT32(-600, clock.pendingSlew());
+    TEST_ASSERT_TRUE(clock.time(late) == before - 100);
+    TEST_ASSERT_EQUAL_UINT32(0, clock.ms(late));
+    clock.update(clock.secondStart() + 1000900);
+    TEST_ASSERT_EQUAL_INT32(-100, clock.pendingSlew());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_boundaries);
+    RUN_TEST(test_offset_and_resync);
+    RUN_TEST(test_slew);
+    return UNITY_END();
+}
@@ -32,7 +32,7 @@ function styles() {
                 content: ['dist/*.html'],
                 fontFace: true,
                 keyframes: true,
-                safelist: ['badge', 'fadeout', 'loading']
+                safelist: ['badge', 'fadeout', 'loading', 'active']
 
             }))
             .pipe(rename('styles.css'))
@@ -1,4 +1,12 @@
 
+// The config as the clock last reported it, patchConfig only sends the
+// fields that differ from it
+let syncedConfig = {};
+
+function cloneConfig(conf) {
+    return JSON.parse(JSON.stringify(conf));
+}
+
 async function postConfig(saveData = false) {
     if (document.getElementById("configform").checkValidity()) {
         conf = app.models.config;
@@ -28,6 +36,7 @@ async function postConfig(saveData = false) {
                 resetRequired = false;
                 console.log(data);
                 app.models.config = data;
+                syncedConfig = cloneConfig(data);
             }
         })
         .catch((error) => {
@@ -38,6 +47,47 @@ async function postConfig(saveData = false) {
         });
 }
 
+async function patchConfig() {
+    if (!document.getElementById("configform").checkValidity()) {
+        return false;
+    }
+    const conf = app.models.config;
+    let changes = {};
+    for (const key in conf) {
+        if (key === "saveData" || key === "reset" || key === "pinsLocked") {
+            continue;
+        }
+        if (JSON.stringify(conf[key]) !== JSON.stringify(syncedConfig[key])) {
+            changes[key] = cloneConfig(conf[key]);
+        }
+    }
+    if (Object.keys(changes).length === 0) {
+        return true;
+    }
+    changes.reset = resetRequired;
+    return fetch('data.json', {
+        method: 'PATCH',
+        headers: {
+            'Content-Type': 'application/json',
+        },
+        body: JSON.stringify(changes),
+    })
+        .then(function (response) {
+            if (!response.ok) {
+                throw new Error('Failed to update settings!');
+            }
+            return response.json();
+        })
+        .then(data => {
+            delete changes.reset;
+            Object.assign(syncedConfig, changes, data);
+        })
+        .catch((error) => {
+            console.error('Error:', error);
+            showToast('toast-error', 1)
+        });
+}
+
 async function getConfig() {
     return fetch('/data.json')
         .then(function (response) {
@@ -48,6 +98,7 @@ async function getConfig() {
                 throw new Error('Failed to load settings!');
             }
         }).then(function (json) {
+            syncedConfig = cloneConfig(json);
             return json;
         });
 }
@@ -0,0 +1,75 @@
+let previewSocket = null;
+let previewPixels = null;
+
+function togglePreview() {
+    if (previewSocket) {
+        previewSocket.close();
+        return;
+    }
+    let button = document.getElementById("preview-button");
+    previewSocket = new WebSocket("ws://" + window.location.hostname + ":81/");
+    previewSocket.binaryType = "arraybuffer";
+    previewSocket.onopen = function () {
+        button.classList.add("active");
+    };
+    previewSocket.onclose = function () {
+        previewSocket = null;
+        button.classList.remove("active");
+    };
+    previewSocket.onmessage = function (event) {
+        applyPreviewFrame(new DataView(event.data));
+        // the clock sends the next frame once this one is drawn
+        requestAnimationFrame(function () {
+            drawPreview();
+            if (previewSocket) {
+                previewSocket.send("1");
+            }
+        });
+    };
+}
+
+// Applies the runs of changed pixels, keyframes carry all of them
+function applyPreviewFrame(view) {
+    const count = view.getUint16(1, true);
+    const bgCount = view.getUint16(3, true);
+    if ((view.getUint8(0) & 1) || !previewPixels || previewPixels.count != count || previewPixels.bgCount != bgCount) {
+        previewPixels = { count: count, bgCount: bgCount, rgb: new Uint8Array((count + bgCount) * 3) };
+    }
+    let offset = 5;
+    while (offset < view.byteLength) {
+        const start = view.getUint16(offset, true);
+        const length = view.getUint8(offset + 2);
+        offset += 3;
+        previewPixels.rgb.set(new Uint8Array(view.buffer, view.byteOffset + offset, length * 3), start * 3);
+        offset += length * 3;
+    }
+}
+
+// Draws the clock face as a ring starting at the 12 o'clock LED, the
+// date hands on an inner ring and the backlight on an outer one
+function drawPreview() {
+    const canvas = document.getElementById("preview");
+    if (!canvas || !previewPixels) {
+        return;
+    }
+    const ctx = canvas.getContext("2d");
+    const center = canvas.width / 2;
+    ctx.clearRect(0, 0, canvas.width, canvas.height);
+
+    function ring(first, count, radius, root) {
+        const dot = Math.max(1.5, Math.min(8, Math.PI * radius / count * 0.8));
+        for (let i = 0; i < count; i++) {
+            const angle = ((i - root + count) % count) / count * 2 * Math.PI - Math.PI / 2;
+            const p = (first + i) * 3;
+            ctx.fillStyle = "rgb(" + previewPixels.rgb[p] + "," + previewPixels.rgb[p + 1] + "," + previewPixels.rgb[p + 2] + ")";
+            ctx.beginPath();
+            ctx.arc(center + Math.cos(angle) * radius, center + Math.sin(angle) * radius, dot, 0, 2 * Math.PI);
+            ctx.fill();
+        }
+    }
+
+    const clockCount = Math.min(config.clockLedCount || previewPixels.count, previewPixels.count);
+    ring(0, clockCount, center * 0.75, (config.ledRoot || 1) - 1);
+    ring(clockCount, previewPixels.count - clockCount, center * 0.5, 0);
+    ring(previewPixels.count, previewPixels.bgCount, center * 0.92, 0);
+}
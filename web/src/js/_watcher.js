@@ -9,7 +9,7 @@ function initWatcher() {
             saveButton.classList.add('badge');
             clearInterval(configInterval);
             configInterval = window.setInterval(function () {
-                postConfig(false);
+                patchConfig();
                 clearInterval(configInterval);
             }, 500);
         });